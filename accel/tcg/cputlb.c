@@ -499,6 +499,13 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
+static void tlb_count_large_page_flush(CPUState *cpu, int midx)
+{
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+
+    qatomic_set(&d->large_page_flush_count, d->large_page_flush_count + 1);
+}
+
 static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
 {
     vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
@@ -509,6 +516,7 @@ static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
         tlb_debug("forcing full flush midx %d (%016"
                   VADDR_PRIx "/%016" VADDR_PRIx ")\n",
                   midx, lp_addr, lp_mask);
+        tlb_count_large_page_flush(cpu, midx);
         tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
     } else {
         if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
@@ -695,6 +703,7 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
         tlb_debug("forcing full flush midx %d ("
                   "%016" VADDR_PRIx "/%016" VADDR_PRIx ")\n",
                   midx, d->large_page_addr, d->large_page_mask);
+        tlb_count_large_page_flush(cpu, midx);
         tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
         return;
     }
@@ -1239,8 +1248,11 @@ static bool tlb_fill_align(CPUState *cpu, vaddr addr, MMUAccessType type,
                            bool probe, uintptr_t ra)
 {
     const TCGCPUOps *ops = cpu->cc->tcg_ops;
+    CPUTLBDesc *d = &cpu->neg.tlb.d[mmu_idx];
     CPUTLBEntryFull full;
 
+    qatomic_set(&d->fill_count, d->fill_count + 1);
+
     if (ops->tlb_fill_align) {
         if (ops->tlb_fill_align(cpu, &full, addr, type, mmu_idx,
                                 memop, size, probe, ra)) {
@@ -1326,6 +1338,9 @@ static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
             CPUTLBEntryFull *f2 = &cpu->neg.tlb.d[mmu_idx].vfulltlb[vidx];
             CPUTLBEntryFull tmpf;
             tmpf = *f1; *f1 = *f2; *f2 = tmpf;
+
+            qatomic_set(&cpu->neg.tlb.d[mmu_idx].vtlb_hit_count,
+                        cpu->neg.tlb.d[mmu_idx].vtlb_hit_count + 1);
             return true;
         }
     }
@@ -1976,6 +1991,7 @@ static uint64_t do_ld_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
     MemoryRegion *mr;
     hwaddr mr_offset;
     MemTxAttrs attrs;
+    bool release_lock;
 
     tcg_debug_assert(size > 0 && size <= 8);
 
@@ -1983,9 +1999,13 @@ static uint64_t do_ld_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    BQL_LOCK_GUARD();
-    return int_ld_mmio_beN(cpu, full, ret_be, addr, size, mmu_idx,
-                           type, ra, mr, mr_offset);
+    release_lock = prepare_mmio_access(mr);
+    ret_be = int_ld_mmio_beN(cpu, full, ret_be, addr, size, mmu_idx,
+                             type, ra, mr, mr_offset);
+    if (release_lock) {
+        bql_unlock();
+    }
+    return ret_be;
 }
 
 static Int128 do_ld16_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
@@ -1997,6 +2017,7 @@ static Int128 do_ld16_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
     hwaddr mr_offset;
     MemTxAttrs attrs;
     uint64_t a, b;
+    bool release_lock;
 
     tcg_debug_assert(size > 8 && size <= 16);
 
@@ -2004,11 +2025,14 @@ static Int128 do_ld16_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    BQL_LOCK_GUARD();
+    release_lock = prepare_mmio_access(mr);
     a = int_ld_mmio_beN(cpu, full, ret_be, addr, size - 8, mmu_idx,
                         MMU_DATA_LOAD, ra, mr, mr_offset);
     b = int_ld_mmio_beN(cpu, full, ret_be, addr + size - 8, 8, mmu_idx,
                         MMU_DATA_LOAD, ra, mr, mr_offset + size - 8);
+    if (release_lock) {
+        bql_unlock();
+    }
     return int128_make128(b, a);
 }
 
@@ -2517,6 +2541,7 @@ static uint64_t do_st_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
     hwaddr mr_offset;
     MemoryRegion *mr;
     MemTxAttrs attrs;
+    bool release_lock;
 
     tcg_debug_assert(size > 0 && size <= 8);
 
@@ -2524,9 +2549,13 @@ static uint64_t do_st_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    BQL_LOCK_GUARD();
-    return int_st_mmio_leN(cpu, full, val_le, addr, size, mmu_idx,
-                           ra, mr, mr_offset);
+    release_lock = prepare_mmio_access(mr);
+    val_le = int_st_mmio_leN(cpu, full, val_le, addr, size, mmu_idx,
+                             ra, mr, mr_offset);
+    if (release_lock) {
+        bql_unlock();
+    }
+    return val_le;
 }
 
 static uint64_t do_st16_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
@@ -2537,6 +2566,8 @@ static uint64_t do_st16_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
     MemoryRegion *mr;
     hwaddr mr_offset;
     MemTxAttrs attrs;
+    bool release_lock;
+    uint64_t ret;
 
     tcg_debug_assert(size > 8 && size <= 16);
 
@@ -2544,11 +2575,15 @@ static uint64_t do_st16_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    BQL_LOCK_GUARD();
+    release_lock = prepare_mmio_access(mr);
     int_st_mmio_leN(cpu, full, int128_getlo(val_le), addr, 8,
                     mmu_idx, ra, mr, mr_offset);
-    return int_st_mmio_leN(cpu, full, int128_gethi(val_le), addr + 8,
-                           size - 8, mmu_idx, ra, mr, mr_offset + 8);
+    ret = int_st_mmio_leN(cpu, full, int128_gethi(val_le), addr + 8,
+                          size - 8, mmu_idx, ra, mr, mr_offset + 8);
+    if (release_lock) {
+        bql_unlock();
+    }
+    return ret;
 }
 
 /*
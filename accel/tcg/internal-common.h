@@ -18,6 +18,7 @@ extern int64_t max_delay;
 extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
+extern bool tb_partial_flush;
 
 extern bool icount_align_option;
 
@@ -48,6 +49,7 @@ static inline bool cpu_plugin_mem_cbs_enabled(const CPUState *cpu)
 }
 
 TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s);
+void tb_evict_or_flush__exclusive_or_serial(void);
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
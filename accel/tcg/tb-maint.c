@@ -794,7 +794,7 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 {
     /* If it is already been done on request of another CPU, just retry. */
     if (tb_ctx.tb_flush_count == tb_flush_count.host_int) {
-        tb_flush__exclusive_or_serial();
+        tb_evict_or_flush__exclusive_or_serial();
     }
 }
 
@@ -917,8 +917,12 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
  * In user-mode, call with mmap_lock held.
  * In !user-mode, if @rm_from_page_list is set, call with the TB's pages'
  * locks held.
+ * If @inval_jmp_cache is clear, the caller must flush the tb_jmp_cache
+ * of all cpus itself.
+ * Returns false if the TB had already been removed from the QHT.
  */
-static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
+static bool do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list,
+                                  bool inval_jmp_cache)
 {
     uint32_t h;
     tb_page_addr_t phys_pc;
@@ -936,7 +940,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     h = tb_hash_func(phys_pc, (orig_cflags & CF_PCREL ? 0 : tb->pc),
                      tb->flags, tb->cs_base, orig_cflags);
     if (!qht_remove(&tb_ctx.htable, tb, h)) {
-        return;
+        return false;
     }
 
     /* remove the TB from the page list */
@@ -945,7 +949,9 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     }
 
     /* remove the TB from the hash list */
-    tb_jmp_cache_inval_tb(tb);
+    if (inval_jmp_cache) {
+        tb_jmp_cache_inval_tb(tb);
+    }
 
     /* suppress this TB from the two jump lists */
     tb_remove_from_jmp_list(tb, 0);
@@ -953,15 +959,23 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 
     /* suppress any remaining jumps to this TB */
     tb_jmp_unlink(tb);
+    return true;
+}
 
-    qatomic_set(&tb_ctx.tb_phys_invalidate_count,
-                tb_ctx.tb_phys_invalidate_count + 1);
+/* Invalidate one TB on behalf of the guest, i.e. not as part of eviction. */
+static void do_tb_phys_invalidate_count(TranslationBlock *tb,
+                                        bool rm_from_page_list)
+{
+    if (do_tb_phys_invalidate(tb, rm_from_page_list, true)) {
+        qatomic_set(&tb_ctx.tb_phys_invalidate_count,
+                    tb_ctx.tb_phys_invalidate_count + 1);
+    }
 }
 
 static void tb_phys_invalidate__locked(TranslationBlock *tb)
 {
     qemu_thread_jit_write();
-    do_tb_phys_invalidate(tb, true);
+    do_tb_phys_invalidate_count(tb, true);
     qemu_thread_jit_execute();
 }
 
@@ -973,10 +987,57 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 {
     if (page_addr == -1 && tb_page_addr0(tb) != -1) {
         tb_lock_pages(tb);
-        do_tb_phys_invalidate(tb, true);
+        do_tb_phys_invalidate_count(tb, true);
         tb_unlock_pages(tb);
     } else {
-        do_tb_phys_invalidate(tb, false);
+        do_tb_phys_invalidate_count(tb, false);
+    }
+}
+
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+
+    if (tb_page_addr0(tb) != -1) {
+        tb_lock_pages(tb);
+        do_tb_phys_invalidate(tb, true, false);
+        tb_unlock_pages(tb);
+    }
+    return false;
+}
+
+/*
+ * Make room in the code buffer once tcg_tb_alloc() has failed.
+ * With partial flushes, retire only the oldest region, unlinking its
+ * TBs from the QHT, the page lists, the jump lists and tb_jmp_cache,
+ * and fall back to a full flush if every region is in use.
+ */
+void tb_evict_or_flush__exclusive_or_serial(void)
+{
+    int ret = -1;
+
+    if (tb_partial_flush) {
+        trace_tb_evict_region();
+        qemu_thread_jit_write();
+        ret = tcg_region_evict_oldest(tb_evict_iter, NULL);
+        qemu_thread_jit_execute();
+    }
+    if (ret > 0) {
+        CPUState *cpu;
+
+        /*
+         * Flush the jump caches once for the whole region rather than
+         * per TB, which for CF_PCREL would mean a full flush for each
+         * evicted TB.  No vCPU runs until we return, so doing it after
+         * the walk is fine.
+         */
+        CPU_FOREACH(cpu) {
+            tcg_flush_jmp_cache(cpu);
+        }
+        qatomic_inc(&tb_ctx.tb_evict_count);
+        qemu_plugin_flush_cb();
+    } else if (ret < 0) {
+        tb_flush__exclusive_or_serial();
     }
 }
 
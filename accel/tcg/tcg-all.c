@@ -52,6 +52,7 @@ struct TCGState {
 
     OnOffAuto mttcg_enabled;
     bool one_insn_per_tb;
+    bool partial_flush;
     int splitwx_enabled;
     unsigned long tb_size;
 };
@@ -83,6 +84,7 @@ static void tcg_accel_instance_init(Object *obj)
 }
 
 bool one_insn_per_tb;
+bool tb_partial_flush;
 
 #ifndef CONFIG_USER_ONLY
 static void tcg_vm_change_state(void *opaque, bool running, RunState state)
@@ -242,6 +244,19 @@ static void tcg_set_one_insn_per_tb(Object *obj, bool value, Error **errp)
     qatomic_set(&one_insn_per_tb, value);
 }
 
+static bool tcg_get_partial_flush(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->partial_flush;
+}
+
+static void tcg_set_partial_flush(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->partial_flush = value;
+    qatomic_set(&tb_partial_flush, value);
+}
+
 static int tcg_gdbstub_supported_sstep_flags(AccelState *as)
 {
     /*
@@ -288,6 +303,13 @@ static void tcg_accel_class_init(ObjectClass *oc, const void *data)
                                    tcg_set_one_insn_per_tb);
     object_class_property_set_description(oc, "one-insn-per-tb",
         "Only put one guest insn in each translation block");
+
+    object_class_property_add_bool(oc, "partial-flush",
+                                   tcg_get_partial_flush,
+                                   tcg_set_partial_flush);
+    object_class_property_set_description(oc, "partial-flush",
+        "Evict the oldest translations instead of all of them "
+        "when the translation cache is full");
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -104,6 +104,7 @@ struct tb_tree_stats {
     size_t max_target_size;
     size_t direct_jmp_count;
     size_t direct_jmp2_count;
+    size_t linked_jmp_count;
     size_t cross_page;
 };
 
@@ -129,6 +130,12 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
             tst->direct_jmp2_count++;
         }
     }
+    for (int n = 0; n < ARRAY_SIZE(tb->jmp_dest); n++) {
+        /* The LSB tags an outgoing jump whose TB is being invalidated. */
+        if (qatomic_read(&tb->jmp_dest[n]) & ~(uintptr_t)1) {
+            tst->linked_jmp_count++;
+        }
+    }
     return false;
 }
 
@@ -147,19 +154,48 @@ static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+static void tlb_dump_mmu_idx_info(GString *buf)
+{
+    for (int i = 0; i < NB_MMU_MODES; i++) {
+        size_t fill = 0, vtlb_hit = 0, lp_flush = 0;
+        CPUState *cpu;
+
+        CPU_FOREACH(cpu) {
+            CPUTLBDesc *d = &cpu->neg.tlb.d[i];
+
+            fill += qatomic_read(&d->fill_count);
+            vtlb_hit += qatomic_read(&d->vtlb_hit_count);
+            lp_flush += qatomic_read(&d->large_page_flush_count);
+        }
+        if (fill || vtlb_hit || lp_flush) {
+            g_string_append_printf(buf, "TLB mmu_idx %-2d      fills %zu, "
+                                   "victim hits %zu, "
+                                   "large page flushes %zu\n",
+                                   i, fill, vtlb_hit, lp_flush);
+        }
+    }
+}
+
 static void tcg_dump_flush_info(GString *buf)
 {
     size_t flush_full, flush_part, flush_elide;
 
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB evict count      %u\n",
+                           qatomic_read(&tb_ctx.tb_evict_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+    g_string_append_printf(buf, "TB translate count  %u\n",
+                           qatomic_read(&tb_ctx.tb_gen_count));
+    g_string_append_printf(buf, "TB duplicate count  %u\n",
+                           qatomic_read(&tb_ctx.tb_gen_dup_count));
 
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    tlb_dump_mmu_idx_info(buf);
 }
 
 static void dump_exec_info(GString *buf)
@@ -197,6 +233,12 @@ static void dump_exec_info(GString *buf)
                            nb_tbs ? (tst.direct_jmp_count * 100) / nb_tbs : 0,
                            tst.direct_jmp2_count,
                            nb_tbs ? (tst.direct_jmp2_count * 100) / nb_tbs : 0);
+    g_string_append_printf(buf, "linked jump count   %zu "
+                           "(%zu%% of direct jumps)\n",
+                           tst.linked_jmp_count,
+                           tst.direct_jmp_count + tst.direct_jmp2_count ?
+                           (tst.linked_jmp_count * 100) /
+                           (tst.direct_jmp_count + tst.direct_jmp2_count) : 0);
 
     qht_statistics_init(&tb_ctx.htable, &hst);
     print_qht_statistics(hst, buf);
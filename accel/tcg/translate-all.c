@@ -291,7 +291,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
         /* flush must be done */
         if (cpu_in_serial_context(cpu)) {
             trace_tb_gen_code_buffer_overflow("tcg_tb_alloc");
-            tb_flush__exclusive_or_serial();
+            tb_evict_or_flush__exclusive_or_serial();
             goto buffer_overflow;
         }
         queue_tb_flush(cpu);
@@ -397,6 +397,13 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
     }
     tb->tc.size = gen_code_size;
 
+    /*
+     * Count every completed translation, including those discarded below
+     * because another thread won the race: each one cost a full pass
+     * through the frontend, optimizer and backend.
+     */
+    qatomic_inc(&tb_ctx.tb_gen_count);
+
     /*
      * For CF_PCREL, attribute all executions of the generated code
      * to its first mapping.
@@ -536,6 +543,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu, TCGTBCPUState s)
         orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
         qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
         tcg_tb_remove(tb);
+        qatomic_inc(&tb_ctx.tb_gen_dup_count);
         return existing_tb;
     }
     return tb;
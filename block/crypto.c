@@ -20,8 +20,10 @@
 
 #include "qemu/osdep.h"
 
+#include "block/aio_task.h"
 #include "block/block_int.h"
 #include "block/qdict.h"
+#include "block/thread-pool.h"
 #include "system/block-backend.h"
 #include "crypto/block.h"
 #include "qapi/opts-visitor.h"
@@ -34,12 +36,22 @@
 #include "qemu/memalign.h"
 #include "crypto.h"
 
+#define BLOCK_CRYPTO_OPT_THREADS "threads"
+
+/* Upper bound for the number of threads working on one request */
+#define BLOCK_CRYPTO_MAX_THREADS 64
+
+/* Smallest part of a request that is worth a thread pool job */
+#define BLOCK_CRYPTO_MIN_TASK_SIZE (64 * 1024)
+
 typedef struct BlockCrypto BlockCrypto;
 
 struct BlockCrypto {
     QCryptoBlock *block;
     bool updating_keys;
     BdrvChild *header;  /* Reference to the detached LUKS header */
+    /* Thread pool workers per request, 0 to process data in the I/O thread */
+    unsigned int threads;
 };
 
 
@@ -224,6 +236,12 @@ static QemuOptsList block_crypto_runtime_opts_luks = {
     .head = QTAILQ_HEAD_INITIALIZER(block_crypto_runtime_opts_luks.head),
     .desc = {
         BLOCK_CRYPTO_OPT_DEF_LUKS_KEY_SECRET(""),
+        {
+            .name = BLOCK_CRYPTO_OPT_THREADS,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of threads used to encrypt and decrypt the data "
+                    "of a request (0 to use the I/O thread)",
+        },
         { /* end of list */ }
     },
 };
@@ -331,6 +349,7 @@ static int block_crypto_open_generic(QCryptoBlockFormat format,
     int ret;
     QCryptoBlockOpenOptions *open_opts = NULL;
     unsigned int cflags = 0;
+    uint64_t threads;
     QDict *cryptoopts = NULL;
 
     GLOBAL_STATE_CODE();
@@ -358,7 +377,17 @@ static int block_crypto_open_generic(QCryptoBlockFormat format,
         goto cleanup;
     }
 
+    threads = qemu_opt_get_number(opts, BLOCK_CRYPTO_OPT_THREADS, 1);
+    if (threads > BLOCK_CRYPTO_MAX_THREADS) {
+        error_setg(errp, "threads must be between 0 and %d",
+                   BLOCK_CRYPTO_MAX_THREADS);
+        ret = -EINVAL;
+        goto cleanup;
+    }
+    crypto->threads = threads;
+
     cryptoopts = qemu_opts_to_qdict(opts, NULL);
+    qdict_del(cryptoopts, BLOCK_CRYPTO_OPT_THREADS);
     qdict_put_str(cryptoopts, "format", QCryptoBlockFormat_str(format));
 
     open_opts = block_crypto_open_opts_init(cryptoopts, errp);
@@ -480,6 +509,105 @@ static int block_crypto_reopen_prepare(BDRVReopenState *state,
  */
 #define BLOCK_CRYPTO_MAX_IO_SIZE (1024 * 1024)
 
+/*
+ * BlockCryptoEncDecFunc: common prototype of qcrypto_block_encrypt() and
+ * qcrypto_block_decrypt() functions.
+ */
+typedef int (*BlockCryptoEncDecFunc)(QCryptoBlock *block, uint64_t offset,
+                                     uint8_t *buf, size_t len, Error **errp);
+
+typedef struct BlockCryptoTask {
+    AioTask task;
+
+    QCryptoBlock *block;
+    BlockCryptoEncDecFunc func;
+    uint64_t offset;
+    uint8_t *buf;
+    size_t len;
+} BlockCryptoTask;
+
+static int block_crypto_encdec_pool_func(void *opaque)
+{
+    BlockCryptoTask *t = opaque;
+
+    return t->func(t->block, t->offset, t->buf, t->len, NULL);
+}
+
+static int coroutine_fn block_crypto_encdec_task_entry(AioTask *task)
+{
+    BlockCryptoTask *t = container_of(task, BlockCryptoTask, task);
+
+    if (thread_pool_submit_co(block_crypto_encdec_pool_func, t) < 0) {
+        return -EIO;
+    }
+    return 0;
+}
+
+/*
+ * Encrypt or decrypt @len bytes of @buf in place, @offset being the
+ * position of the data in the payload.
+ *
+ * Unless disabled with threads=0, the work is done in the thread pool so
+ * that the I/O thread can keep serving other requests.  Large buffers are
+ * split between up to crypto->threads workers.  The QCryptoBlock keeps a
+ * cipher context for each concurrent user, so the parts can be processed
+ * in parallel.
+ */
+static int coroutine_fn
+block_crypto_co_encdec(BlockDriverState *bs, uint64_t offset, uint8_t *buf,
+                       size_t len, BlockCryptoEncDecFunc func)
+{
+    BlockCrypto *crypto = bs->opaque;
+    uint64_t sector_size = qcrypto_block_get_sector_size(crypto->block);
+    AioTaskPool *pool = NULL;
+    size_t part_size;
+    int ret = 0;
+
+    if (!crypto->threads) {
+        return func(crypto->block, offset, buf, len, NULL) < 0 ? -EIO : 0;
+    }
+
+    part_size = MAX(DIV_ROUND_UP(len, crypto->threads),
+                    BLOCK_CRYPTO_MIN_TASK_SIZE);
+    part_size = QEMU_ALIGN_UP(part_size, sector_size);
+    if (part_size < len) {
+        pool = aio_task_pool_new(crypto->threads);
+    }
+
+    while (len && aio_task_pool_status(pool) == 0) {
+        BlockCryptoTask local_task;
+        BlockCryptoTask *t = pool ? g_new(BlockCryptoTask, 1) : &local_task;
+        size_t cur_len = MIN(len, part_size);
+
+        *t = (BlockCryptoTask) {
+            .task.func = block_crypto_encdec_task_entry,
+            .block = crypto->block,
+            .func = func,
+            .offset = offset,
+            .buf = buf,
+            .len = cur_len,
+        };
+
+        if (pool) {
+            aio_task_pool_start_task(pool, &t->task);
+        } else {
+            ret = t->task.func(&t->task);
+        }
+
+        offset += cur_len;
+        buf += cur_len;
+        len -= cur_len;
+    }
+
+    if (pool) {
+        aio_task_pool_wait_all(pool);
+        ret = aio_task_pool_status(pool);
+        aio_task_pool_free(pool);
+    }
+
+    return ret;
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
                        QEMUIOVector *qiov, BdrvRequestFlags flags)
@@ -522,9 +650,9 @@ block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto cleanup;
         }
 
-        if (qcrypto_block_decrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
+        ret = block_crypto_co_encdec(bs, offset + bytes_done, cipher_data,
+                                     cur_bytes, qcrypto_block_decrypt);
+        if (ret < 0) {
             goto cleanup;
         }
 
@@ -579,9 +707,9 @@ block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
         qemu_iovec_to_buf(qiov, bytes_done, cipher_data, cur_bytes);
 
-        if (qcrypto_block_encrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
+        ret = block_crypto_co_encdec(bs, offset + bytes_done, cipher_data,
+                                     cur_bytes, qcrypto_block_encrypt);
+        if (ret < 0) {
             goto cleanup;
         }
 
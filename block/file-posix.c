@@ -38,6 +38,7 @@
 #include "block/raw-aio.h"
 #include "qobject/qdict.h"
 #include "qobject/qstring.h"
+#include "system/memory.h" /* for ram_block_discard_disable() */
 
 #include "scsi/pr-manager.h"
 #include "scsi/constants.h"
@@ -183,6 +184,7 @@ typedef struct BDRVRawState {
     bool use_linux_aio:1;
     bool has_laio_fdsync:1;
     bool use_linux_io_uring:1;
+    bool use_fixed_bufs:1;
     bool use_mpath:1;
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
@@ -585,6 +587,13 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+#ifdef CONFIG_LINUX_IO_URING
+        {
+            .name = "aio-fixed-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest RAM as io_uring fixed buffers (default: off)",
+        },
+#endif
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -662,6 +671,7 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     s->use_linux_aio = (aio == BLOCKDEV_AIO_OPTIONS_NATIVE);
 #ifdef CONFIG_LINUX_IO_URING
     s->use_linux_io_uring = (aio == BLOCKDEV_AIO_OPTIONS_IO_URING);
+    s->use_fixed_bufs = qemu_opt_get_bool(opts, "aio-fixed-buffers", false);
 #endif
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
@@ -838,6 +848,22 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
         /* When extending regular files, we get zeros from the OS */
         bs->supported_truncate_flags = BDRV_REQ_ZERO_WRITE;
     }
+
+    if (s->use_fixed_bufs) {
+        if (!s->use_linux_io_uring) {
+            error_setg(errp, "aio-fixed-buffers requires aio=io_uring");
+            ret = -EINVAL;
+            goto fail;
+        }
+
+        /* Fixed buffers pin guest RAM, see raw_register_buf() */
+        ret = ram_block_discard_disable(true);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "ram_block_discard_disable() failed");
+            goto fail;
+        }
+        bs->supported_write_flags |= BDRV_REQ_REGISTERED_BUF;
+    }
     ret = 0;
 fail:
     if (ret < 0 && s->fd != -1) {
@@ -2703,8 +2729,40 @@ static void raw_close(BlockDriverState *bs)
         qemu_close(s->fd);
         s->fd = -1;
     }
+
+    if (s->use_fixed_bufs) {
+        ram_block_discard_disable(false);
+    }
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * With aio-fixed-buffers, guest RAM is registered with the io_urings of all
+ * AioContexts so that requests with BDRV_REQ_REGISTERED_BUF can use
+ * IORING_OP_READ_FIXED/IORING_OP_WRITE_FIXED and the kernel does not have to
+ * pin and map the pages for every request.
+ */
+static bool raw_register_buf(BlockDriverState *bs, void *host, size_t size,
+                             Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (!s->use_fixed_bufs) {
+        return true;
+    }
+    return aio_register_fixed_buf(host, size, errp);
+}
+
+static void raw_unregister_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->use_fixed_bufs) {
+        aio_unregister_fixed_buf(host, size);
+    }
+}
+#endif
+
 /**
  * Truncates the given regular file @fd to @offset and, when growing, fills the
  * new space according to @prealloc.
@@ -3974,6 +4032,10 @@ BlockDriver bdrv_file = {
     .bdrv_reopen_commit = raw_reopen_commit,
     .bdrv_reopen_abort = raw_reopen_abort,
     .bdrv_close = raw_close,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
     .bdrv_co_create = raw_co_create,
     .bdrv_co_create_opts = raw_co_create_opts,
     .bdrv_has_zero_init = bdrv_has_zero_init_1,
@@ -4431,6 +4493,10 @@ static BlockDriver bdrv_host_device = {
     .bdrv_parse_filename = hdev_parse_filename,
     .bdrv_open          = hdev_open,
     .bdrv_close         = raw_close,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf  = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
     .bdrv_reopen_prepare = raw_reopen_prepare,
     .bdrv_reopen_commit  = raw_reopen_commit,
     .bdrv_reopen_abort   = raw_reopen_abort,
@@ -4570,6 +4636,10 @@ static BlockDriver bdrv_host_cdrom = {
     .bdrv_parse_filename    = cdrom_parse_filename,
     .bdrv_open              = cdrom_open,
     .bdrv_close             = raw_close,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf      = raw_register_buf,
+    .bdrv_unregister_buf    = raw_unregister_buf,
+#endif
     .bdrv_reopen_prepare    = raw_reopen_prepare,
     .bdrv_reopen_commit     = raw_reopen_commit,
     .bdrv_reopen_abort      = raw_reopen_abort,
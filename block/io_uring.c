@@ -26,6 +26,9 @@ typedef struct {
     int fd;
     BdrvRequestFlags flags;
 
+    /* io_uring fixed buffer that holds the data, or -1 */
+    int buf_index;
+
     /*
      * Buffered reads may require resubmission, see
      * luring_resubmit_short_read().
@@ -48,7 +51,12 @@ static void luring_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
     case QEMU_AIO_WRITE:
     {
         int luring_flags = (flags & BDRV_REQ_FUA) ? RWF_DSYNC : 0;
-        if (luring_flags != 0 || qiov->niov > 1) {
+        if (req->buf_index >= 0) {
+            struct iovec *iov = qiov->iov;
+            io_uring_prep_write_fixed(sqe, fd, iov->iov_base, iov->iov_len,
+                                      offset, req->buf_index);
+            sqe->rw_flags = luring_flags;
+        } else if (luring_flags != 0 || qiov->niov > 1) {
 #ifdef HAVE_IO_URING_PREP_WRITEV2
             io_uring_prep_writev2(sqe, fd, qiov->iov,
                                   qiov->niov, offset, luring_flags);
@@ -79,6 +87,11 @@ static void luring_prep_sqe(struct io_uring_sqe *sqe, void *opaque)
         if (qiov->niov > 1) {
             io_uring_prep_readv(sqe, fd, qiov->iov, qiov->niov,
                                 offset + req->total_read);
+        } else if (req->buf_index >= 0) {
+            /* After a short read, this is still within the fixed buffer */
+            struct iovec *iov = qiov->iov;
+            io_uring_prep_read_fixed(sqe, fd, iov->iov_base, iov->iov_len,
+                                     offset + req->total_read, req->buf_index);
         } else {
             /* The man page says non-vectored is faster than vectored */
             struct iovec *iov = qiov->iov;
@@ -178,6 +191,9 @@ static void luring_cqe_handler(CqeHandler *cqe_handler)
 
     req->ret = ret;
     qemu_iovec_destroy(&req->resubmit_qiov);
+    if (req->buf_index >= 0) {
+        aio_fixed_buf_put(req->buf_index);
+    }
 
     /*
      * If the coroutine is already entered it must be in luring_co_submit() and
@@ -201,10 +217,18 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd,
         .fd         = fd,
         .offset     = offset,
         .flags      = flags,
+        .buf_index  = -1,
     };
 
     req.cqe_handler.cb = luring_cqe_handler;
 
+    /* Guest RAM may be registered with the kernel, see raw_register_buf() */
+    if ((flags & BDRV_REQ_REGISTERED_BUF) && qiov && qiov->niov == 1 &&
+        (type == QEMU_AIO_READ || type == QEMU_AIO_WRITE)) {
+        req.buf_index = aio_fixed_buf_get(qiov->iov[0].iov_base,
+                                          qiov->iov[0].iov_len);
+    }
+
     trace_luring_co_submit(bs, &req, fd, offset, qiov ? qiov->size : 0, type);
     aio_add_sqe(luring_prep_sqe, &req, &req.cqe_handler);
 
@@ -25,6 +25,8 @@
 #include "qemu/osdep.h"
 #include "block/block-io.h"
 #include "qemu/memalign.h"
+#include "qemu/queue.h"
+#include "qemu/coroutine.h"
 #include "qcow2.h"
 #include "trace.h"
 
@@ -33,8 +35,18 @@ typedef struct Qcow2CachedTable {
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    /* Link in Qcow2Cache.lru, valid while ref == 0 */
+    QTAILQ_ENTRY(Qcow2CachedTable) next;
 } Qcow2CachedTable;
 
+/* A table being read by qcow2_cache_get_concurrent() */
+typedef struct Qcow2CacheLoad {
+    uint64_t offset;
+    /* Lookups of the same table waiting for the read to complete */
+    CoQueue  waiters;
+    QLIST_ENTRY(Qcow2CacheLoad) next;
+} Qcow2CacheLoad;
+
 struct Qcow2Cache {
     Qcow2CachedTable       *entries;
     struct Qcow2Cache      *depends;
@@ -44,6 +56,14 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+    /* Maps the offset of each cached table to its entry */
+    GHashTable             *index;
+    /* Unused entries, empty ones first, then least recently used first */
+    QTAILQ_HEAD(, Qcow2CachedTable) lru;
+    /* Reads in flight with s->lock dropped */
+    QLIST_HEAD(, Qcow2CacheLoad) loads;
+    /* Incremented whenever a table is written back or discarded */
+    uint64_t                change_gen;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -59,6 +79,27 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+/*
+ * Change the offset of entry @i, keeping the index up to date.  An
+ * unused entry that becomes empty is moved to the front of the LRU list
+ * so that it is reused first.
+ */
+static void qcow2_cache_set_offset(Qcow2Cache *c, int i, int64_t offset)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    if (t->offset) {
+        g_hash_table_remove(c->index, &t->offset);
+    }
+    t->offset = offset;
+    if (offset) {
+        g_hash_table_insert(c->index, &t->offset, t);
+    } else if (t->ref == 0) {
+        QTAILQ_REMOVE(&c->lru, t, next);
+        QTAILQ_INSERT_HEAD(&c->lru, t, next);
+    }
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -106,7 +147,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
+            qcow2_cache_set_offset(c, i, 0);
             c->entries[i].lru_counter = 0;
             i++;
             to_clean++;
@@ -125,6 +166,7 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2Cache *c;
+    int i;
 
     assert(num_tables > 0);
     assert(is_power_of_2(table_size));
@@ -142,8 +184,15 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
         qemu_vfree(c->table_array);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
+    }
+
+    c->index = g_hash_table_new(g_int64_hash, g_int64_equal);
+    QTAILQ_INIT(&c->lru);
+    for (i = 0; i < num_tables; i++) {
+        QTAILQ_INSERT_TAIL(&c->lru, &c->entries[i], next);
     }
+    QLIST_INIT(&c->loads);
 
     return c;
 }
@@ -155,7 +204,9 @@ int qcow2_cache_destroy(Qcow2Cache *c)
     for (i = 0; i < c->size; i++) {
         assert(c->entries[i].ref == 0);
     }
+    assert(QLIST_EMPTY(&c->loads));
 
+    g_hash_table_destroy(c->index);
     qemu_vfree(c->table_array);
     g_free(c->entries);
     g_free(c);
@@ -226,6 +277,7 @@ qcow2_cache_entry_flush(BlockDriverState *bs, Qcow2Cache *c, int i)
         BLKDBG_EVENT(bs->file, BLKDBG_L2_UPDATE);
     }
 
+    c->change_gen++;
     ret = bdrv_pwrite(bs->file, c->entries[i].offset, c->table_size,
                       qcow2_cache_get_table_addr(c, i), 0);
     if (ret < 0) {
@@ -307,6 +359,7 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
         return ret;
     }
 
+    g_hash_table_remove_all(c->index);
     for (i = 0; i < c->size; i++) {
         assert(c->entries[i].ref == 0);
         c->entries[i].offset = 0;
@@ -325,11 +378,10 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                    void **table, bool read_from_disk)
 {
     BDRVQcow2State *s = bs->opaque;
+    Qcow2CachedTable *t;
+    int64_t key = offset;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -344,29 +396,21 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
-        }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+    t = g_hash_table_lookup(c->index, &key);
+    if (t) {
+        i = t - c->entries;
+        goto found;
+    }
 
-    if (min_lru_index == -1) {
+    t = QTAILQ_FIRST(&c->lru);
+    if (!t) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
     /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
+    i = t - c->entries;
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -377,7 +421,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    qcow2_cache_set_offset(c, i, 0);
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -390,11 +434,13 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
         }
     }
 
-    c->entries[i].offset = offset;
+    qcow2_cache_set_offset(c, i, offset);
 
     /* And return the right table */
 found:
-    c->entries[i].ref++;
+    if (c->entries[i].ref++ == 0) {
+        QTAILQ_REMOVE(&c->lru, &c->entries[i], next);
+    }
     *table = qcow2_cache_get_table_addr(c, i);
 
     trace_qcow2_cache_get_done(qemu_coroutine_self(),
@@ -409,6 +455,88 @@ int qcow2_cache_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     return qcow2_cache_do_get(bs, c, offset, table, true);
 }
 
+/*
+ * Like qcow2_cache_get(), but when called in coroutine context s->lock
+ * is dropped while the table is read from disk, so that misses for other
+ * tables are served in the meantime.  The caller must revalidate anything
+ * it derived from the metadata before the call.
+ *
+ * The table is read into a separate buffer and only enters the cache
+ * once the lock is taken again, so other users of the cache never see
+ * it half loaded.  Concurrent lookups of the same table wait for the
+ * first read to complete instead of issuing their own.
+ */
+int coroutine_mixed_fn qcow2_cache_get_concurrent(BlockDriverState *bs,
+                                                  Qcow2Cache *c,
+                                                  uint64_t offset,
+                                                  void **table)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2CacheLoad load, *l;
+    uint64_t change_gen;
+    void *buf;
+    int ret;
+
+    if (!qemu_in_coroutine() || !QEMU_IS_ALIGNED(offset, c->table_size)) {
+        return qcow2_cache_get(bs, c, offset, table);
+    }
+
+retry:
+    if (qcow2_cache_is_table_offset(c, offset)) {
+        return qcow2_cache_get(bs, c, offset, table);
+    }
+
+    QLIST_FOREACH(l, &c->loads, next) {
+        if (l->offset == offset) {
+            trace_qcow2_cache_get_wait(qemu_coroutine_self(),
+                                       c == s->l2_table_cache, offset);
+            qemu_co_queue_wait(&l->waiters, &s->lock);
+            goto retry;
+        }
+    }
+
+    buf = qemu_try_blockalign(bs->file->bs, c->table_size);
+    if (!buf) {
+        return qcow2_cache_get(bs, c, offset, table);
+    }
+
+    load.offset = offset;
+    qemu_co_queue_init(&load.waiters);
+    QLIST_INSERT_HEAD(&c->loads, &load, next);
+    change_gen = c->change_gen;
+
+    if (c == s->l2_table_cache) {
+        BLKDBG_CO_EVENT(bs->file, BLKDBG_L2_LOAD);
+    }
+
+    qemu_co_mutex_unlock(&s->lock);
+    ret = bdrv_co_pread(bs->file, offset, c->table_size, buf, 0);
+    qemu_co_mutex_lock(&s->lock);
+
+    QLIST_REMOVE(&load, next);
+    qemu_co_queue_restart_all(&load.waiters);
+
+    if (ret < 0) {
+        goto out;
+    }
+
+    if (qcow2_cache_is_table_offset(c, offset) ||
+        c->change_gen != change_gen) {
+        /* The table may have changed while it was read, drop our copy */
+        ret = qcow2_cache_get(bs, c, offset, table);
+        goto out;
+    }
+
+    ret = qcow2_cache_do_get(bs, c, offset, table, false);
+    if (ret == 0) {
+        memcpy(*table, buf, c->table_size);
+    }
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
 int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table)
 {
@@ -424,6 +552,7 @@ void qcow2_cache_put(Qcow2Cache *c, void **table)
 
     if (c->entries[i].ref == 0) {
         c->entries[i].lru_counter = ++c->lru_counter;
+        QTAILQ_INSERT_TAIL(&c->lru, &c->entries[i], next);
     }
 
     assert(c->entries[i].ref >= 0);
@@ -438,14 +567,10 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    int64_t key = offset;
+    Qcow2CachedTable *t = g_hash_table_lookup(c->index, &key);
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
-    }
-    return NULL;
+    return t ? qcow2_cache_get_table_addr(c, t - c->entries) : NULL;
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
@@ -454,7 +579,8 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     assert(c->entries[i].ref == 0);
 
-    c->entries[i].offset = 0;
+    c->change_gen++;
+    qcow2_cache_set_offset(c, i, 0);
     c->entries[i].lru_counter = 0;
     c->entries[i].dirty = false;
 
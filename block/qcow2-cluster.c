@@ -219,6 +219,24 @@ l2_load(BlockDriverState *bs, uint64_t offset,
                            (void **)l2_slice);
 }
 
+/*
+ * Like l2_load(), but s->lock may be dropped while the slice is read
+ * from disk so that lookups of other slices can proceed in parallel.
+ * The caller must check that the L1 entry still points to @l2_offset.
+ */
+static int coroutine_mixed_fn GRAPH_RDLOCK
+l2_load_concurrent(BlockDriverState *bs, uint64_t offset,
+                   uint64_t l2_offset, uint64_t **l2_slice)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int start_of_slice = l2_entry_size(s) *
+        (offset_to_l2_index(s, offset) - offset_to_l2_slice_index(s, offset));
+
+    return qcow2_cache_get_concurrent(bs, s->l2_table_cache,
+                                      l2_offset + start_of_slice,
+                                      (void **)l2_slice);
+}
+
 /*
  * Writes an L1 entry to disk (note that depending on the alignment
  * requirements this function may write more that just one entry in
@@ -581,11 +599,15 @@ do_perform_cow_write(BlockDriverState *bs, uint64_t cluster_offset,
  * file. The subcluster type is stored in *subcluster_type.
  * Compressed clusters are always processed one by one.
  *
+ * In coroutine context, s->lock must be held and is dropped while L2
+ * tables are read from disk.
+ *
  * Returns 0 on success, -errno in error cases.
  */
-int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
-                          unsigned int *bytes, uint64_t *host_offset,
-                          QCow2SubclusterType *subcluster_type)
+int coroutine_mixed_fn
+qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
+                      unsigned int *bytes, uint64_t *host_offset,
+                      QCow2SubclusterType *subcluster_type)
 {
     BDRVQcow2State *s = bs->opaque;
     unsigned int l2_index, sc_index;
@@ -612,6 +634,7 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
 
     *host_offset = 0;
 
+again:
     /* seek to the l2 offset in the l1 table */
 
     l1_index = offset_to_l1_index(s, offset);
@@ -635,11 +658,18 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
 
     /* load the l2 slice in memory */
 
-    ret = l2_load(bs, offset, l2_offset, &l2_slice);
+    ret = l2_load_concurrent(bs, offset, l2_offset, &l2_slice);
     if (ret < 0) {
         return ret;
     }
 
+    /* The L2 table may have been replaced while s->lock was dropped */
+    if (l1_index >= s->l1_size ||
+        (s->l1_table[l1_index] & L1E_OFFSET_MASK) != l2_offset) {
+        qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+        goto again;
+    }
+
     /* find the cluster offset for the given disk offset */
 
     l2_index = offset_to_l2_slice_index(s, offset);
@@ -2386,6 +2416,7 @@ expand_zero_clusters_in_l1(BlockDriverState *bs, uint64_t *l1_table,
                     goto fail;
                 }
 
+                qcow2_dedup_forget(bs, offset, s->cluster_size);
                 ret = bdrv_pwrite_zeroes(s->data_file, offset,
                                          s->cluster_size, 0);
                 if (ret < 0) {
@@ -2542,6 +2573,135 @@ fail:
     return ret;
 }
 
+/*
+ * Set or clear QCOW_OFLAG_COPIED in the L2 entry of the cluster at guest
+ * @offset, provided that it maps @host_offset and that its L2 table is
+ * not shared with a snapshot.  Deduplication uses this to keep the flag
+ * in line with the refcount of the clusters that it shares.
+ *
+ * Returns 1 if the entry was updated or already had the requested flag,
+ * 0 if it does not map @host_offset and -errno on failure.
+ */
+int qcow2_cluster_set_copied(BlockDriverState *bs, uint64_t offset,
+                             uint64_t host_offset, bool copied)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t l1_index, l2_offset, l2_entry, *l2_slice;
+    QCow2ClusterType type;
+    int l2_index;
+    int ret;
+
+    l1_index = offset_to_l1_index(s, offset);
+    if (l1_index >= s->l1_size ||
+        !(s->l1_table[l1_index] & QCOW_OFLAG_COPIED)) {
+        return 0;
+    }
+
+    l2_offset = s->l1_table[l1_index] & L1E_OFFSET_MASK;
+    if (!l2_offset) {
+        return 0;
+    }
+
+    ret = l2_load(bs, offset, l2_offset, &l2_slice);
+    if (ret < 0) {
+        return ret;
+    }
+
+    l2_index = offset_to_l2_slice_index(s, offset);
+    l2_entry = get_l2_entry(s, l2_slice, l2_index);
+    type = qcow2_get_cluster_type(bs, l2_entry);
+
+    /*
+     * Preallocated zero clusters may be written in place when zero
+     * clusters are expanded, so they are never made shared.
+     */
+    if ((type != QCOW2_CLUSTER_NORMAL &&
+         (type != QCOW2_CLUSTER_ZERO_ALLOC || !copied)) ||
+        (l2_entry & L2E_OFFSET_MASK) != host_offset) {
+        ret = 0;
+        goto out;
+    }
+
+    if (!!(l2_entry & QCOW_OFLAG_COPIED) != copied) {
+        if (copied) {
+            l2_entry |= QCOW_OFLAG_COPIED;
+        } else {
+            l2_entry &= ~QCOW_OFLAG_COPIED;
+        }
+        qcow2_cache_entry_mark_dirty(s->l2_table_cache, l2_slice);
+        set_l2_entry(s, l2_slice, l2_index, l2_entry);
+    }
+    ret = 1;
+
+out:
+    qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+    return ret;
+}
+
+/*
+ * Make the unallocated cluster at guest @offset point to the existing
+ * cluster at @host_offset and take a reference to it.  The new L2 entry
+ * does not have QCOW_OFLAG_COPIED because the cluster is shared.
+ *
+ * Returns 1 on success, 0 if the guest cluster is allocated or has an
+ * allocation in flight, and -errno on failure.
+ */
+int qcow2_cluster_link_shared(BlockDriverState *bs, uint64_t offset,
+                              uint64_t host_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t *l2_slice;
+    QCowL2Meta *m;
+    QCow2ClusterType type;
+    int l2_index;
+    int ret;
+
+    assert(!has_subclusters(s));
+    offset = start_of_cluster(s, offset);
+
+    QLIST_FOREACH(m, &s->cluster_allocs, next_in_flight) {
+        uint64_t start = start_of_cluster(s, l2meta_cow_start(m));
+        uint64_t end = ROUND_UP(l2meta_cow_end(m), s->cluster_size);
+
+        if (offset + s->cluster_size > start && offset < end) {
+            return 0;
+        }
+    }
+
+    ret = get_cluster_table(bs, offset, &l2_slice, &l2_index);
+    if (ret < 0) {
+        return ret;
+    }
+
+    type = qcow2_get_cluster_type(bs, get_l2_entry(s, l2_slice, l2_index));
+    if (type != QCOW2_CLUSTER_UNALLOCATED && type != QCOW2_CLUSTER_ZERO_PLAIN) {
+        ret = 0;
+        goto out;
+    }
+
+    ret = qcow2_update_cluster_refcount(bs, host_offset >> s->cluster_bits,
+                                        1, false, QCOW2_DISCARD_NEVER);
+    if (ret < 0) {
+        goto out;
+    }
+
+    if (s->use_lazy_refcounts) {
+        qcow2_mark_dirty(bs);
+    }
+    if (qcow2_need_accurate_refcounts(s)) {
+        qcow2_cache_set_dependency(bs, s->l2_table_cache,
+                                   s->refcount_block_cache);
+    }
+
+    qcow2_cache_entry_mark_dirty(s->l2_table_cache, l2_slice);
+    set_l2_entry(s, l2_slice, l2_index, host_offset);
+    ret = 1;
+
+out:
+    qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+    return ret;
+}
+
 void qcow2_parse_compressed_l2_entry(BlockDriverState *bs, uint64_t l2_entry,
                                      uint64_t *coffset, int *csize)
 {
@@ -0,0 +1,333 @@
+/*
+ * Deduplication of full cluster writes for the QCOW2 format
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * With the "dedup" option, every write that covers a whole cluster is
+ * fingerprinted with SHA-256.  Freshly allocated clusters are recorded in
+ * an index, and a later write of the same data to an unallocated guest
+ * cluster takes a reference to the recorded cluster instead of writing
+ * the data again.
+ *
+ * Shared clusters are never written in place: their L2 entries do not
+ * have QCOW_OFLAG_COPIED, so a write to them allocates a new cluster, as
+ * for clusters shared with internal snapshots.  A recorded cluster with
+ * a refcount of 1 can still be written in place, but such writes drop it
+ * from the index before they touch the data (qcow2_dedup_forget()).  This
+ * is what allows sharing clusters on the strength of the fingerprint
+ * alone, without reading them back.
+ *
+ * When the refcount of a shared cluster drops back to 1, the remaining
+ * reference should get QCOW_OFLAG_COPIED back.  qcow2_dedup_fixup() does
+ * that before metadata is written out.
+ *
+ * The index is not stored in the image; it only knows about the clusters
+ * written since the image was opened.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qcow2.h"
+#include "trace.h"
+
+/* Upper bound for the number of clusters in the index */
+#define QCOW2_DEDUP_MAX_ENTRIES (1 << 20)
+
+typedef struct Qcow2DedupEntry {
+    uint8_t digest[QCOW2_DEDUP_DIGEST_SIZE];
+    /* Cluster that holds the data */
+    uint64_t host_offset;
+    /* Guest clusters that were made to point to it, the writer first */
+    GArray *guest_offsets;
+    /* Identifies the write that allocated the cluster */
+    uint64_t id;
+    /* The data is still being written, the cluster cannot be shared yet */
+    bool pending;
+} Qcow2DedupEntry;
+
+static guint qcow2_dedup_hash(gconstpointer key)
+{
+    /* SHA-256 output is evenly distributed already */
+    return ldl_he_p(key);
+}
+
+static gboolean qcow2_dedup_equal(gconstpointer a, gconstpointer b)
+{
+    return !memcmp(a, b, QCOW2_DEDUP_DIGEST_SIZE);
+}
+
+static void qcow2_dedup_entry_free(gpointer p)
+{
+    Qcow2DedupEntry *e = p;
+
+    g_array_free(e->guest_offsets, true);
+    g_free(e);
+}
+
+static void qcow2_dedup_remove(BDRVQcow2State *s, Qcow2DedupEntry *e)
+{
+    g_hash_table_remove(s->dedup_index, e->digest);
+    g_hash_table_remove(s->dedup_unshared, &e->host_offset);
+    /* Frees @e */
+    g_hash_table_remove(s->dedup_clusters, &e->host_offset);
+}
+
+void qcow2_dedup_enable(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (s->dedup) {
+        return;
+    }
+
+    s->dedup_index = g_hash_table_new(qcow2_dedup_hash, qcow2_dedup_equal);
+    s->dedup_clusters = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                              NULL, qcow2_dedup_entry_free);
+    s->dedup_unshared = g_hash_table_new(g_int64_hash, g_int64_equal);
+    s->dedup = true;
+}
+
+/*
+ * Drop the index.  Call qcow2_dedup_fixup() first if the image may have
+ * been modified.
+ */
+void qcow2_dedup_disable(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (!s->dedup) {
+        return;
+    }
+
+    g_hash_table_destroy(s->dedup_unshared);
+    g_hash_table_destroy(s->dedup_index);
+    g_hash_table_destroy(s->dedup_clusters);
+    s->dedup_unshared = NULL;
+    s->dedup_index = NULL;
+    s->dedup_clusters = NULL;
+    s->dedup = false;
+}
+
+/*
+ * Point the unallocated guest cluster at @offset to a cluster that is
+ * known to hold data with the fingerprint @digest, if there is one.
+ *
+ * Returns 1 if the cluster was linked, in which case there is nothing
+ * left to write, 0 if the data must be written normally and -errno on
+ * failure.
+ */
+int qcow2_dedup_link(BlockDriverState *bs, uint64_t offset,
+                     const uint8_t *digest)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2DedupEntry *e;
+    uint64_t refcount, owner = 0;
+    unsigned i;
+    int ret;
+
+    e = g_hash_table_lookup(s->dedup_index, digest);
+    if (!e || e->pending) {
+        return 0;
+    }
+
+    ret = qcow2_get_refcount(bs, e->host_offset >> s->cluster_bits,
+                             &refcount);
+    if (ret < 0) {
+        return ret;
+    }
+    if (refcount >= s->refcount_max) {
+        return 0;
+    }
+
+    if (refcount == 1) {
+        /*
+         * The only reference must lose QCOW_OFLAG_COPIED before the cluster
+         * is shared.  If it is not one of ours, it belongs to a snapshot or
+         * the L2 table is shared; leave the cluster alone.
+         */
+        ret = 0;
+        for (i = 0; i < e->guest_offsets->len && ret == 0; i++) {
+            owner = g_array_index(e->guest_offsets, uint64_t, i);
+            ret = qcow2_cluster_set_copied(bs, owner, e->host_offset, false);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret == 0) {
+            trace_qcow2_dedup_stale(bs, e->host_offset);
+            qcow2_dedup_remove(s, e);
+            return 0;
+        }
+
+        /*
+         * The owner's L2 entry must be on disk without the flag before any
+         * other L2 entry points to the cluster.  Otherwise, after a crash,
+         * the owner could still write in place to a shared cluster.
+         */
+        ret = qcow2_cache_flush(bs, s->l2_table_cache);
+        if (ret < 0) {
+            qcow2_cluster_set_copied(bs, owner, e->host_offset, true);
+            return ret;
+        }
+    } else if (refcount == 0) {
+        trace_qcow2_dedup_stale(bs, e->host_offset);
+        qcow2_dedup_remove(s, e);
+        return 0;
+    }
+
+    ret = qcow2_cluster_link_shared(bs, offset, e->host_offset);
+    if (ret <= 0) {
+        if (refcount == 1) {
+            /* Still the only reference, give the flag back */
+            qcow2_cluster_set_copied(bs, owner, e->host_offset, true);
+        }
+        return ret;
+    }
+
+    trace_qcow2_dedup_link(bs, offset, e->host_offset);
+    offset = start_of_cluster(s, offset);
+    g_array_append_val(e->guest_offsets, offset);
+    g_hash_table_remove(s->dedup_unshared, &e->host_offset);
+    return 1;
+}
+
+/*
+ * Record that the guest cluster at @offset is being written to the newly
+ * allocated cluster at @host_offset with data that has the fingerprint
+ * @digest.  The cluster can only be shared once qcow2_dedup_commit() has
+ * been called with the returned identifier, after the data and the L2
+ * entry have been written.
+ *
+ * Returns 0 if the cluster was not recorded.
+ */
+uint64_t qcow2_dedup_add(BlockDriverState *bs, uint64_t offset,
+                         uint64_t host_offset, const uint8_t *digest)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2DedupEntry *e;
+
+    if (g_hash_table_size(s->dedup_clusters) >= QCOW2_DEDUP_MAX_ENTRIES ||
+        g_hash_table_contains(s->dedup_index, digest)) {
+        return 0;
+    }
+
+    assert(!g_hash_table_contains(s->dedup_clusters, &host_offset));
+
+    e = g_new0(Qcow2DedupEntry, 1);
+    memcpy(e->digest, digest, QCOW2_DEDUP_DIGEST_SIZE);
+    e->host_offset = host_offset;
+    e->guest_offsets = g_array_new(false, false, sizeof(uint64_t));
+    offset = start_of_cluster(s, offset);
+    g_array_append_val(e->guest_offsets, offset);
+    e->id = ++s->dedup_next_id;
+    e->pending = true;
+
+    g_hash_table_insert(s->dedup_index, e->digest, e);
+    g_hash_table_insert(s->dedup_clusters, &e->host_offset, e);
+    return e->id;
+}
+
+void qcow2_dedup_commit(BlockDriverState *bs, uint64_t host_offset,
+                        uint64_t id)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2DedupEntry *e = g_hash_table_lookup(s->dedup_clusters, &host_offset);
+
+    /* The cluster may have been rewritten or freed in the meantime */
+    if (e && e->id == id) {
+        e->pending = false;
+    }
+}
+
+/*
+ * Drop the clusters in the given host range from the index.  Must be
+ * called before data is written in place, and when a cluster is freed.
+ */
+void qcow2_dedup_forget(BlockDriverState *bs, uint64_t host_offset,
+                        uint64_t bytes)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t offset, end = host_offset + bytes;
+
+    if (!s->dedup || !g_hash_table_size(s->dedup_clusters)) {
+        return;
+    }
+
+    for (offset = start_of_cluster(s, host_offset); offset < end;
+         offset += s->cluster_size) {
+        Qcow2DedupEntry *e = g_hash_table_lookup(s->dedup_clusters, &offset);
+
+        if (e) {
+            qcow2_dedup_remove(s, e);
+        }
+    }
+}
+
+/* Called when the refcount of the cluster at @host_offset dropped to 1 */
+void qcow2_dedup_unshare(BlockDriverState *bs, uint64_t host_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2DedupEntry *e;
+
+    if (!s->dedup) {
+        return;
+    }
+
+    e = g_hash_table_lookup(s->dedup_clusters, &host_offset);
+    if (e && e->guest_offsets->len > 1) {
+        g_hash_table_add(s->dedup_unshared, &e->host_offset);
+    }
+}
+
+/*
+ * Set QCOW_OFLAG_COPIED again for clusters that we shared and that only
+ * have one reference left.  Without this they would still be handled
+ * correctly, but every write to them would allocate a new cluster and
+ * 'qemu-img check' would complain about the flag.
+ */
+int qcow2_dedup_fixup(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    GHashTableIter iter;
+    gpointer key;
+
+    if (!s->dedup) {
+        return 0;
+    }
+
+    g_hash_table_iter_init(&iter, s->dedup_unshared);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        Qcow2DedupEntry *e = g_hash_table_lookup(s->dedup_clusters, key);
+        uint64_t refcount;
+        unsigned i;
+        int ret;
+
+        ret = qcow2_get_refcount(bs, e->host_offset >> s->cluster_bits,
+                                 &refcount);
+        if (ret < 0) {
+            return ret;
+        }
+
+        if (refcount == 1) {
+            for (i = 0; i < e->guest_offsets->len; i++) {
+                uint64_t offset = g_array_index(e->guest_offsets, uint64_t, i);
+
+                ret = qcow2_cluster_set_copied(bs, offset, e->host_offset,
+                                               true);
+                if (ret < 0) {
+                    return ret;
+                }
+                if (ret > 0) {
+                    break;
+                }
+            }
+        }
+
+        g_hash_table_iter_remove(&iter);
+    }
+
+    return 0;
+}
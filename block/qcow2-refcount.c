@@ -904,6 +904,10 @@ update_refcount(BlockDriverState *bs, int64_t offset, int64_t length,
             if (s->discard_passthrough[type]) {
                 queue_discard(bs, cluster_offset, s->cluster_size);
             }
+
+            qcow2_dedup_forget(bs, cluster_offset, s->cluster_size);
+        } else if (decrease && refcount == 1) {
+            qcow2_dedup_unshare(bs, cluster_offset);
         }
     }
 
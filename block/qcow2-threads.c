@@ -1,5 +1,5 @@
 /*
- * Threaded data processing for Qcow2: compression, encryption
+ * Threaded data processing for Qcow2: compression, encryption, fingerprinting
  *
  * Copyright (c) 2004-2006 Fabrice Bellard
  * Copyright (c) 2018 Virtuozzo International GmbH. All rights reserved.
@@ -37,6 +37,7 @@
 #include "block/block-io.h"
 #include "block/thread-pool.h"
 #include "crypto.h"
+#include "crypto/hash.h"
 
 static int coroutine_fn
 qcow2_co_process(BlockDriverState *bs, ThreadPoolFunc *func, void *arg)
@@ -525,3 +526,45 @@ qcow2_co_decrypt(BlockDriverState *bs, uint64_t host_offset,
     return qcow2_co_encdec(bs, host_offset, guest_offset, buf, len,
                            qcrypto_block_decrypt);
 }
+
+
+/*
+ * Deduplication
+ */
+
+typedef struct Qcow2FingerprintData {
+    const void *buf;
+    size_t len;
+    uint8_t *digest;
+} Qcow2FingerprintData;
+
+static int qcow2_fingerprint_pool_func(void *opaque)
+{
+    Qcow2FingerprintData *data = opaque;
+    size_t digest_len = QCOW2_DEDUP_DIGEST_SIZE;
+
+    return qcrypto_hash_bytes(QCRYPTO_HASH_ALGO_SHA256, data->buf, data->len,
+                              &data->digest, &digest_len, NULL);
+}
+
+/*
+ * qcow2_co_fingerprint()
+ *
+ * Stores the SHA-256 digest of @buf in @digest, which must have room for
+ * QCOW2_DEDUP_DIGEST_SIZE bytes.
+ *
+ * Returns 0 on success, -EIO on failure.
+ */
+int coroutine_fn
+qcow2_co_fingerprint(BlockDriverState *bs, const void *buf, size_t len,
+                     uint8_t *digest)
+{
+    Qcow2FingerprintData arg = {
+        .buf = buf,
+        .len = len,
+        .digest = digest,
+    };
+
+    return qcow2_co_process(bs, qcow2_fingerprint_pool_func, &arg) < 0 ?
+           -EIO : 0;
+}
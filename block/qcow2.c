@@ -685,6 +685,7 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_DISCARD_SNAPSHOT,
     QCOW2_OPT_DISCARD_OTHER,
     QCOW2_OPT_DISCARD_NO_UNREF,
+    QCOW2_OPT_DEDUP,
     QCOW2_OPT_OVERLAP,
     QCOW2_OPT_OVERLAP_TEMPLATE,
     QCOW2_OPT_OVERLAP_MAIN_HEADER,
@@ -734,6 +735,11 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_BOOL,
             .help = "Do not unreference discarded clusters",
         },
+        {
+            .name = QCOW2_OPT_DEDUP,
+            .type = QEMU_OPT_BOOL,
+            .help = "Share clusters written with identical data",
+        },
         {
             .name = QCOW2_OPT_OVERLAP,
             .type = QEMU_OPT_STRING,
@@ -978,6 +984,7 @@ typedef struct Qcow2ReopenState {
     int overlap_check;
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
+    bool dedup;
     uint64_t cache_clean_interval;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
@@ -1157,6 +1164,26 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->dedup = qemu_opt_get_bool(opts, QCOW2_OPT_DEDUP, false);
+    if (r->dedup) {
+        const char *conflict = NULL;
+
+        if (s->incompatible_features & QCOW2_INCOMPAT_DATA_FILE) {
+            conflict = "an external data file";
+        } else if (s->crypt_method_header) {
+            conflict = "encryption";
+        } else if (has_subclusters(s)) {
+            conflict = "extended L2 entries";
+        } else if (r->discard_no_unref) {
+            conflict = "discard-no-unref";
+        }
+        if (conflict) {
+            error_setg(errp, "dedup cannot be used with %s", conflict);
+            ret = -EINVAL;
+            goto fail;
+        }
+    }
+
     switch (s->crypt_method_header) {
     case QCOW_CRYPT_NONE:
         if (encryptfmt) {
@@ -1239,6 +1266,16 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
 
     s->discard_no_unref = r->discard_no_unref;
 
+    /*
+     * Reopening flushes the image first, so no clusters are waiting for
+     * qcow2_dedup_fixup() when the index is dropped.
+     */
+    if (r->dedup) {
+        qcow2_dedup_enable(bs);
+    } else {
+        qcow2_dedup_disable(bs);
+    }
+
     if (s->cache_clean_interval != r->cache_clean_interval) {
         cache_clean_timer_del(bs);
         s->cache_clean_interval = r->cache_clean_interval;
@@ -1909,6 +1946,7 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
     /* else pre-write overlap checks in cache_destroy may crash */
     s->l1_table = NULL;
     cache_clean_timer_del(bs);
+    qcow2_dedup_disable(bs);
     if (s->l2_table_cache) {
         qcow2_cache_destroy(s->l2_table_cache);
     }
@@ -2675,6 +2713,104 @@ static coroutine_fn GRAPH_RDLOCK int qcow2_co_pwritev_task_entry(AioTask *task)
                                  t->l2meta);
 }
 
+/*
+ * Write the whole cluster at guest @offset with deduplication: if a
+ * cluster with the same data is known, the guest cluster is made to point
+ * to it, otherwise the data is written to a new cluster that is added to
+ * the index.
+ *
+ * Called with s->lock unlocked.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+qcow2_co_pwritev_dedup(BlockDriverState *bs, uint64_t offset,
+                       QEMUIOVector *qiov, uint64_t qiov_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint8_t digest[QCOW2_DEDUP_DIGEST_SIZE];
+    unsigned int cur_bytes = s->cluster_size;
+    uint64_t host_offset, id = 0;
+    QCowL2Meta *l2meta = NULL;
+    QEMUIOVector buf_qiov;
+    void *buf;
+    int ret;
+
+    /*
+     * The guest may change the data while it is written, so fingerprint
+     * and write a copy of it.
+     */
+    buf = qemu_try_blockalign(s->data_file->bs, s->cluster_size);
+    if (buf == NULL) {
+        return -ENOMEM;
+    }
+    qemu_iovec_to_buf(qiov, qiov_offset, buf, s->cluster_size);
+    qemu_iovec_init_buf(&buf_qiov, buf, s->cluster_size);
+
+    ret = qcow2_co_fingerprint(bs, buf, s->cluster_size, digest);
+    if (ret < 0) {
+        goto out;
+    }
+
+    qemu_co_mutex_lock(&s->lock);
+
+    ret = qcow2_dedup_link(bs, offset, digest);
+    if (ret != 0) {
+        qemu_co_mutex_unlock(&s->lock);
+        ret = MIN(ret, 0);
+        goto out;
+    }
+
+    ret = qcow2_alloc_host_offset(bs, offset, &cur_bytes, &host_offset,
+                                  &l2meta);
+    if (ret < 0) {
+        goto out_locked;
+    }
+    assert(cur_bytes == s->cluster_size);
+
+    ret = qcow2_pre_write_overlap_check(bs, 0, host_offset, cur_bytes, true);
+    if (ret < 0) {
+        goto out_locked;
+    }
+    qcow2_dedup_forget(bs, host_offset, cur_bytes);
+
+    /* Only newly allocated clusters are recorded */
+    if (l2meta) {
+        id = qcow2_dedup_add(bs, offset, host_offset, digest);
+    }
+
+    qemu_co_mutex_unlock(&s->lock);
+
+    /* qcow2_co_pwritev_task() consumes l2meta */
+    ret = qcow2_co_pwritev_task(bs, host_offset, offset, cur_bytes,
+                                &buf_qiov, 0, l2meta);
+    l2meta = NULL;
+
+    /* On failure, the cluster was freed and dropped from the index */
+    qemu_co_mutex_lock(&s->lock);
+    if (id && ret == 0) {
+        qcow2_dedup_commit(bs, host_offset, id);
+    }
+
+out_locked:
+    qcow2_handle_l2meta(bs, &l2meta, false);
+    qemu_co_mutex_unlock(&s->lock);
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
+/*
+ * This function can count as GRAPH_RDLOCK because qcow2_co_pwritev_part() holds
+ * the graph lock and keeps it until this coroutine has terminated.
+ */
+static coroutine_fn GRAPH_RDLOCK int
+qcow2_co_pwritev_dedup_task_entry(AioTask *task)
+{
+    Qcow2AioTask *t = container_of(task, Qcow2AioTask, task);
+
+    return qcow2_co_pwritev_dedup(t->bs, t->offset, t->qiov, t->qiov_offset);
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
                       QEMUIOVector *qiov, size_t qiov_offset,
@@ -2703,6 +2839,27 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
                             - offset_in_cluster);
         }
 
+        if (s->dedup) {
+            /*
+             * Whole clusters are written one by one so that they can be
+             * fingerprinted, the rest is written as usual
+             */
+            if (offset_in_cluster == 0 && bytes >= s->cluster_size) {
+                cur_bytes = s->cluster_size;
+                if (!aio && cur_bytes != bytes) {
+                    aio = aio_task_pool_new(QCOW2_MAX_WORKERS);
+                }
+                ret = qcow2_add_task(bs, aio, qcow2_co_pwritev_dedup_task_entry,
+                                     0, 0, offset, cur_bytes, qiov,
+                                     qiov_offset, NULL);
+                if (ret < 0) {
+                    goto fail_nometa;
+                }
+                goto next;
+            }
+            cur_bytes = MIN(cur_bytes, s->cluster_size - offset_in_cluster);
+        }
+
         qemu_co_mutex_lock(&s->lock);
 
         ret = qcow2_alloc_host_offset(bs, offset, &cur_bytes,
@@ -2716,6 +2873,7 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
         if (ret < 0) {
             goto out_locked;
         }
+        qcow2_dedup_forget(bs, host_offset, cur_bytes);
 
         qemu_co_mutex_unlock(&s->lock);
 
@@ -2730,6 +2888,7 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto fail_nometa;
         }
 
+next:
         bytes -= cur_bytes;
         offset += cur_bytes;
         qiov_offset += cur_bytes;
@@ -2772,6 +2931,12 @@ static int GRAPH_RDLOCK qcow2_inactivate(BlockDriverState *bs)
                           bdrv_get_device_or_node_name(bs));
     }
 
+    ret = qcow2_dedup_fixup(bs);
+    if (ret) {
+        result = ret;
+        error_report("Failed to update shared clusters: %s", strerror(-ret));
+    }
+
     ret = qcow2_cache_flush(bs, s->l2_table_cache);
     if (ret) {
         result = ret;
@@ -2806,6 +2971,7 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
     }
 
     cache_clean_timer_del(bs);
+    qcow2_dedup_disable(bs);
     qcow2_cache_destroy(s->l2_table_cache);
     qcow2_cache_destroy(s->refcount_block_cache);
 
@@ -4266,6 +4432,7 @@ qcow2_co_copy_range_to(BlockDriverState *bs,
         if (ret < 0) {
             goto fail;
         }
+        qcow2_dedup_forget(bs, host_offset, cur_bytes);
 
         qemu_co_mutex_unlock(&s->lock);
         ret = bdrv_co_copy_range_to(src, src_offset, s->data_file, host_offset,
@@ -5064,7 +5231,10 @@ static coroutine_fn GRAPH_RDLOCK int qcow2_co_flush_to_os(BlockDriverState *bs)
     int ret;
 
     qemu_co_mutex_lock(&s->lock);
-    ret = qcow2_write_caches(bs);
+    ret = qcow2_dedup_fixup(bs);
+    if (ret == 0) {
+        ret = qcow2_write_caches(bs);
+    }
     qemu_co_mutex_unlock(&s->lock);
 
     return ret;
@@ -150,6 +150,10 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_DEDUP "dedup"
+
+/* Size of the SHA-256 fingerprints used for deduplication */
+#define QCOW2_DEDUP_DIGEST_SIZE 32
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -422,6 +426,17 @@ typedef struct BDRVQcow2State {
      * is to convert the image with the desired compression type set.
      */
     Qcow2CompressionType compression_type;
+
+    /*
+     * Deduplication of full cluster writes, see qcow2-dedup.c.  The index
+     * only lives in memory and is rebuilt from the clusters written while
+     * the image is open.
+     */
+    bool dedup;
+    GHashTable *dedup_index;     /* fingerprint -> Qcow2DedupEntry */
+    GHashTable *dedup_clusters;  /* host cluster offset -> Qcow2DedupEntry */
+    GHashTable *dedup_unshared;  /* entries whose refcount dropped to 1 */
+    uint64_t dedup_next_id;      /* for Qcow2DedupEntry.id */
 } BDRVQcow2State;
 
 typedef struct Qcow2COWRegion {
@@ -931,7 +946,7 @@ int GRAPH_RDLOCK qcow2_write_l1_entry(BlockDriverState *bs, int l1_index);
 int qcow2_encrypt_sectors(BDRVQcow2State *s, int64_t sector_num,
                           uint8_t *buf, int nb_sectors, bool enc, Error **errp);
 
-int GRAPH_RDLOCK
+int coroutine_mixed_fn GRAPH_RDLOCK
 qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
                       unsigned int *bytes, uint64_t *host_offset,
                       QCow2SubclusterType *subcluster_type);
@@ -967,6 +982,14 @@ qcow2_expand_zero_clusters(BlockDriverState *bs,
                            BlockDriverAmendStatusCB *status_cb,
                            void *cb_opaque);
 
+int GRAPH_RDLOCK
+qcow2_cluster_set_copied(BlockDriverState *bs, uint64_t offset,
+                         uint64_t host_offset, bool copied);
+
+int GRAPH_RDLOCK
+qcow2_cluster_link_shared(BlockDriverState *bs, uint64_t offset,
+                          uint64_t host_offset);
+
 /* qcow2-snapshot.c functions */
 int GRAPH_RDLOCK
 qcow2_snapshot_create(BlockDriverState *bs, QEMUSnapshotInfo *sn_info);
@@ -1018,6 +1041,10 @@ int GRAPH_RDLOCK
 qcow2_cache_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                 void **table);
 
+int coroutine_mixed_fn GRAPH_RDLOCK
+qcow2_cache_get_concurrent(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
+                           void **table);
+
 int GRAPH_RDLOCK
 qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                       void **table);
@@ -1026,6 +1053,22 @@ void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
 
+/* qcow2-dedup.c functions */
+void qcow2_dedup_enable(BlockDriverState *bs);
+void qcow2_dedup_disable(BlockDriverState *bs);
+
+int GRAPH_RDLOCK
+qcow2_dedup_link(BlockDriverState *bs, uint64_t offset, const uint8_t *digest);
+
+uint64_t qcow2_dedup_add(BlockDriverState *bs, uint64_t offset,
+                         uint64_t host_offset, const uint8_t *digest);
+void qcow2_dedup_commit(BlockDriverState *bs, uint64_t host_offset,
+                        uint64_t id);
+void qcow2_dedup_forget(BlockDriverState *bs, uint64_t host_offset,
+                        uint64_t bytes);
+void qcow2_dedup_unshare(BlockDriverState *bs, uint64_t host_offset);
+int GRAPH_RDLOCK qcow2_dedup_fixup(BlockDriverState *bs);
+
 /* qcow2-bitmap.c functions */
 int coroutine_fn GRAPH_RDLOCK
 qcow2_check_bitmaps_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
@@ -1074,5 +1117,8 @@ qcow2_co_encrypt(BlockDriverState *bs, uint64_t host_offset,
 int coroutine_fn
 qcow2_co_decrypt(BlockDriverState *bs, uint64_t host_offset,
                  uint64_t guest_offset, void *buf, size_t len);
+int coroutine_fn
+qcow2_co_fingerprint(BlockDriverState *bs, const void *buf, size_t len,
+                     uint8_t *digest);
 
 #endif
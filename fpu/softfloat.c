@@ -2901,7 +2901,8 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(&p, s, fmt);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2910,6 +2911,43 @@ float32 float64_to_float32(float64 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
+float32 QEMU_FLATTEN float64_to_float32(float64 xa, float_status *s)
+{
+    union_float64 ua;
+    union_float32 ur;
+
+    ua.s = xa;
+    if (unlikely(!can_use_fpu(s))) {
+        goto soft;
+    }
+
+    float64_input_flush1(&ua.s, s);
+    if (QEMU_HARDFLOAT_1F64_USE_FP) {
+        if (unlikely(!(fpclassify(ua.h) == FP_NORMAL ||
+                       fpclassify(ua.h) == FP_ZERO))) {
+            goto soft;
+        }
+    } else if (unlikely(!float64_is_zero_or_normal(ua.s))) {
+        goto soft;
+    }
+
+    /*
+     * Narrowing can overflow or underflow.  Overflow is handled as in
+     * float32_gen2; a tiny result needs the soft path for the underflow
+     * flag and for flush-to-zero of the output.
+     */
+    ur.h = ua.h;
+    if (unlikely(f32_is_inf(ur))) {
+        float_raise(float_flag_overflow, s);
+    } else if (unlikely(fabsf(ur.h) <= FLT_MIN) && !float64_is_zero(ua.s)) {
+        goto soft;
+    }
+    return ur.s;
+
+ soft:
+    return soft_float64_to_float32(ua.s, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
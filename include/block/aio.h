@@ -317,6 +317,9 @@ struct AioContext {
 
     /* Pending callback state for cqe handlers */
     CqeHandlerSimpleQ cqe_handler_ready_list;
+
+    /* Does fdmon_io_uring have the buffers of aio_register_fixed_buf()? */
+    bool io_uring_fixed_bufs;
 #endif /* CONFIG_LINUX_IO_URING */
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -854,6 +857,55 @@ static inline bool aio_has_io_uring(void)
  */
 void aio_add_sqe(void (*prep_sqe)(struct io_uring_sqe *sqe, void *opaque),
                  void *opaque, CqeHandler *cqe_handler);
+
+/**
+ * aio_register_fixed_buf: Register memory as io_uring fixed buffers.
+ * @host: start of the memory region
+ * @size: size of the memory region in bytes
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Registers the memory region with the io_uring of every AioContext,
+ * including those created later, so that sqes can refer to it with
+ * io_uring_prep_read_fixed() and io_uring_prep_write_fixed() and the index
+ * returned by aio_fixed_buf_get().  This saves mapping the pages for each
+ * request, but pins the whole region in memory.
+ *
+ * Registering the same region again only takes a reference; each successful
+ * call must be balanced by aio_unregister_fixed_buf().
+ *
+ * Returns true on success.
+ */
+bool aio_register_fixed_buf(void *host, size_t size, Error **errp);
+
+/**
+ * aio_unregister_fixed_buf: Undo aio_register_fixed_buf().
+ * @host: start of the memory region
+ * @size: size of the memory region in bytes
+ *
+ * Once the last reference is dropped, waits for the requests that use the
+ * region's fixed buffers to complete.  Must be called from the main loop
+ * thread.
+ */
+void aio_unregister_fixed_buf(void *host, size_t size);
+
+/**
+ * aio_fixed_buf_get: Look up the fixed buffer that contains a buffer.
+ * @buf: start of the buffer
+ * @len: length of the buffer in bytes
+ *
+ * Returns the index to pass to io_uring_prep_read_fixed() or
+ * io_uring_prep_write_fixed() for sqes submitted with aio_add_sqe() in
+ * the current AioContext, or -1 if the buffer is not covered by a single
+ * fixed buffer.  The index stays valid until it is released with
+ * aio_fixed_buf_put() once the request completed.
+ */
+int aio_fixed_buf_get(const void *buf, size_t len);
+
+/**
+ * aio_fixed_buf_put: Release an index returned by aio_fixed_buf_get().
+ * @index: the fixed buffer index
+ */
+void aio_fixed_buf_put(int index);
 #endif /* CONFIG_LINUX_IO_URING */
 
 #endif
@@ -27,9 +27,11 @@ void tb_flush__exclusive_or_serial(void);
  * queue_tb_flush() - add flush to the cpu work queue
  * @cs: CPUState
  *
- * Flush all translation blocks the next time @cs processes the work queue.
- * This should generally be followed by cpu_loop_exit(), so that the work
- * queue is processed promptly.
+ * Make room in the code generation buffer the next time @cs processes
+ * the work queue: flush all translation blocks or, with partial flushes
+ * enabled, only those of the oldest region.  This should generally be
+ * followed by cpu_loop_exit(), so that the work queue is processed
+ * promptly.
  */
 void queue_tb_flush(CPUState *cs);
 
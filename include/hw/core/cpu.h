@@ -288,6 +288,14 @@ typedef struct CPUTLBDesc {
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
     size_t n_used_entries;
+    /*
+     * Statistics, read and written atomically like those in CPUTLBCommon:
+     * misses resolved by the victim tlb, misses that needed tlb_fill,
+     * and full flushes of this mmu_idx forced by a large page.
+     */
+    size_t vtlb_hit_count;
+    size_t fill_count;
+    size_t large_page_flush_count;
     /* The next index to use in the tlb victim table.  */
     size_t vindex;
     /* The tlb victim table, in two parts.  */
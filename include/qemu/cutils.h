@@ -194,6 +194,8 @@ char *freq_to_str(uint64_t freq_hz);
 bool buffer_is_zero_ool(const void *vbuf, size_t len);
 bool buffer_is_zero_ge256(const void *vbuf, size_t len);
 bool test_buffer_is_zero_next_accel(void);
+size_t buffer_is_zero_batch(const void *const *bufs, size_t n, size_t len,
+                            bool *zero);
 
 static inline bool buffer_is_zero_sample3(const char *buf, size_t len)
 {
@@ -80,6 +80,19 @@ struct RAMBlock {
     unsigned long *clear_bmap;
     uint8_t clear_bmap_shift;
 
+    /*
+     * Number of consecutive dirty bitmap syncs that found each chunk
+     * of the block dirtied, used to defer sending chronically hot
+     * pages.  Only allocated on the source side when the
+     * x-defer-hot-pages capability is set; protected like clear_bmap.
+     */
+    uint8_t *hotness;
+    /*
+     * Chunks picked at the last dirty bitmap sync to be left for the
+     * stop-and-copy phase; allocated and protected like hotness.
+     */
+    unsigned long *hot_bmap;
+
     /*
      * RAM block length that corresponds to the used_length on the migration
      * source (after RAM block sizes were synchronized). Especially, after
@@ -38,6 +38,13 @@
 #define SOCKET_MAX_FDS 16
 
 #ifdef QEMU_MSG_ZEROCOPY
+/*
+ * Number of zero copy sends that may be pending before writev() reaps
+ * the notifications that already arrived, so that the error queue does
+ * not pile up until the next flush.
+ */
+#define SOCKET_ZERO_COPY_REAP 64
+
 static int qio_channel_socket_flush_internal(QIOChannel *ioc,
                                              bool block,
                                              Error **errp);
@@ -656,6 +663,11 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
     if (flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) {
 #ifdef QEMU_MSG_ZEROCOPY
         sflags = MSG_ZEROCOPY;
+        if (sioc->zero_copy_queued - sioc->zero_copy_sent >=
+            SOCKET_ZERO_COPY_REAP &&
+            qio_channel_socket_flush_internal(ioc, false, errp) < 0) {
+            return -1;
+        }
 #else
         /*
          * We expect QIOChannel class entry point to have
@@ -17,14 +17,27 @@
 #include "io/channel-socket.h"
 #include "io/channel-util.h"
 #include "options.h"
+#include "ram.h"
 #include "trace.h"
 
 #define OFFSET_OPTION ",offset="
 
 static struct FileOutgoingArgs {
     char *fname;
+    /* Identify the file for x-mapped-ram-incremental */
+    dev_t dev;
+    ino_t ino;
+    uint64_t offset;
 } outgoing_args;
 
+/* The file written by the last completed incremental migration */
+static struct {
+    bool valid;
+    dev_t dev;
+    ino_t ino;
+    uint64_t offset;
+} incremental_base;
+
 /* Remove the offset option from @filespec and return it in @offsetp. */
 
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
@@ -50,6 +63,32 @@ void file_cleanup_outgoing_migration(void)
     outgoing_args.fname = NULL;
 }
 
+/*
+ * Remember the file of the current outgoing migration as the one that
+ * holds everything but the pages dirtied from now on.
+ */
+void file_set_incremental_base(void)
+{
+    incremental_base.valid = true;
+    incremental_base.dev = outgoing_args.dev;
+    incremental_base.ino = outgoing_args.ino;
+    incremental_base.offset = outgoing_args.offset;
+}
+
+/*
+ * Whether the current outgoing migration writes to the file that was
+ * passed to file_set_incremental_base().  Any other file, even one
+ * written by an earlier incremental migration, lacks some of the pages
+ * and must be written in full.
+ */
+bool file_is_incremental_base(void)
+{
+    return incremental_base.valid &&
+           incremental_base.dev == outgoing_args.dev &&
+           incremental_base.ino == outgoing_args.ino &&
+           incremental_base.offset == outgoing_args.offset;
+}
+
 static void file_enable_direct_io(int *flags)
 {
 #ifdef O_DIRECT
@@ -100,22 +139,41 @@ void file_start_outgoing_migration(MigrationState *s,
     g_autofree char *filename = g_strdup(file_args->filename);
     uint64_t offset = file_args->offset;
     QIOChannel *ioc;
+    int flags = O_CREAT | O_WRONLY;
+    struct stat st;
 
     trace_migration_file_outgoing(filename);
 
-    fioc = qio_channel_file_new_path(filename, O_CREAT | O_WRONLY, 0600, errp);
+    /*
+     * An incremental migration reads back the layout and the page
+     * bitmaps of the previous one, and keeps the pages it does not
+     * overwrite.
+     */
+    if (migrate_mapped_ram_incremental()) {
+        flags = O_CREAT | O_RDWR;
+    }
+
+    fioc = qio_channel_file_new_path(filename, flags, 0600, errp);
     if (!fioc) {
         return;
     }
 
-    if (ftruncate(fioc->fd, offset)) {
+    if (!migrate_mapped_ram_incremental() && ftruncate(fioc->fd, offset)) {
         error_setg_errno(errp, errno,
                          "failed to truncate migration file to offset %" PRIx64,
                          offset);
         return;
     }
 
+    if (fstat(fioc->fd, &st) < 0) {
+        error_setg_errno(errp, errno, "failed to stat migration file");
+        return;
+    }
+
     outgoing_args.fname = g_strdup(filename);
+    outgoing_args.dev = st.st_dev;
+    outgoing_args.ino = st.st_ino;
+    outgoing_args.offset = offset;
 
     ioc = QIO_CHANNEL(fioc);
     if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
@@ -255,6 +313,11 @@ int multifd_file_recv_data(MultiFDRecvParams *p, Error **errp)
     MultiFDRecvData *data = p->data;
     size_t ret;
 
+    if (data->zero) {
+        ram_handle_zero(data->opaque, data->size);
+        return 0;
+    }
+
     ret = qio_channel_pread(p->c, (char *) data->opaque,
                             data->size, data->file_offset, errp);
     if (ret != data->size) {
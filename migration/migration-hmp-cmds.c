@@ -244,6 +244,13 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                            info->ram->dirty_sync_missed_zero_copy);
         }
         monitor_printf(mon, "\n");
+
+        if (info->ram->dirty_sync_count) {
+            monitor_printf(mon, "  Last Dirty Sync (us): \tlog=%" PRIu64
+                           ", bitmap=%" PRIu64 "\n",
+                           info->ram->dirty_sync_log_time,
+                           info->ram->dirty_sync_bitmap_time);
+        }
     }
 
     if (!show_all) {
@@ -284,6 +291,19 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->dirty_limit_ring_full_time);
     }
 
+    if (info->has_dirty_limit_budget) {
+        DirtyLimitInfoList *vcpu;
+
+        monitor_printf(mon, "Dirty-limit Budget (MB/s): %" PRIu64 "\n",
+                       info->dirty_limit_budget);
+        for (vcpu = info->dirty_limit_vcpus; vcpu; vcpu = vcpu->next) {
+            monitor_printf(mon, "  vcpu[%" PRIi64 "]: limit %" PRIu64
+                           " MB/s, current %" PRIu64 " MB/s\n",
+                           vcpu->value->cpu_index, vcpu->value->limit_rate,
+                           vcpu->value->current_rate);
+        }
+    }
+
     migration_dump_blocktime(mon, info);
 out:
     qapi_free_MigrationInfo(info);
@@ -42,14 +42,29 @@ typedef struct {
      * since we synchronized bitmaps.
      */
     Stat64 dirty_bytes_last_sync;
+    /*
+     * Dirty page rate in MB/s that all vCPUs together may reach, as
+     * computed by the adaptive dirty limit.
+     */
+    Stat64 dirty_limit_budget;
     /*
      * Number of pages dirtied per second.
      */
     Stat64 dirty_pages_rate;
+    /*
+     * Time in microseconds spent merging the dirty bitmaps of all
+     * RAMBlocks during the last sync.
+     */
+    Stat64 dirty_sync_bitmap_time;
     /*
      * Number of times we have synchronized guest bitmaps.
      */
     Stat64 dirty_sync_count;
+    /*
+     * Time in microseconds spent collecting the dirty log from the
+     * accelerator and memory listeners during the last sync.
+     */
+    Stat64 dirty_sync_log_time;
     /*
      * Number of times zero copy failed to send any page using zero
      * copy.
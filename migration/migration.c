@@ -535,17 +535,17 @@ static int migrate_send_rp_message(MigrationIncomingState *mis,
     return qemu_fflush(mis->to_src_file);
 }
 
-/* Request one page from the source VM at the given start address.
- *   rb: the RAMBlock to request the page in
+/* Request pages from the source VM at the given start address.
+ *   rb: the RAMBlock to request the pages in
  *   Start: Address offset within the RB
  *   Len: Length in bytes required - must be a multiple of pagesize
  */
-int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
-                                      RAMBlock *rb, ram_addr_t start)
+int migrate_send_rp_message_req_range(MigrationIncomingState *mis,
+                                      RAMBlock *rb, ram_addr_t start,
+                                      size_t len)
 {
     uint8_t bufc[12 + 1 + 255]; /* start (8), len (4), rbname up to 256 */
     size_t msglen = 12; /* start + len */
-    size_t len = qemu_ram_pagesize(rb);
     enum mig_rp_message_type msg_type;
     const char *rbname;
     int rbname_len;
@@ -577,6 +577,13 @@ int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
     return migrate_send_rp_message(mis, msg_type, msglen, bufc);
 }
 
+int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
+                                      RAMBlock *rb, ram_addr_t start)
+{
+    return migrate_send_rp_message_req_range(mis, rb, start,
+                                             qemu_ram_pagesize(rb));
+}
+
 int migrate_send_rp_req_pages(MigrationIncomingState *mis,
                               RAMBlock *rb, ram_addr_t start, uint64_t haddr,
                               uint32_t tid)
@@ -1276,6 +1283,10 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         stat64_get(&mig_stats.dirty_sync_count);
     info->ram->dirty_sync_missed_zero_copy =
         stat64_get(&mig_stats.dirty_sync_missed_zero_copy);
+    info->ram->dirty_sync_log_time =
+        stat64_get(&mig_stats.dirty_sync_log_time);
+    info->ram->dirty_sync_bitmap_time =
+        stat64_get(&mig_stats.dirty_sync_bitmap_time);
     info->ram->postcopy_requests =
         stat64_get(&mig_stats.postcopy_requests);
     info->ram->page_size = page_size;
@@ -1314,6 +1325,13 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
 
         info->has_dirty_limit_ring_full_time = true;
         info->dirty_limit_ring_full_time = dirtylimit_ring_full_time();
+
+        if (migrate_dirty_limit_adaptive()) {
+            info->has_dirty_limit_budget = true;
+            info->dirty_limit_budget =
+                stat64_get(&mig_stats.dirty_limit_budget);
+            info->dirty_limit_vcpus = qmp_query_vcpu_dirty_limit(NULL);
+        }
     }
 }
 
@@ -127,6 +127,15 @@ struct MigrationIncomingState {
     QemuMutex rp_mutex;    /* We send replies from multiple threads */
     /* RAMBlock of last request sent to source */
     RAMBlock *last_rb;
+    /*
+     * Sequential fault detection for postcopy prefetch, only accessed by
+     * the fault thread: the last faulting page, the end of the range that
+     * was requested along with it, and the current window in host pages.
+     */
+    RAMBlock *prefetch_rb;
+    ram_addr_t prefetch_last;
+    ram_addr_t prefetch_end;
+    unsigned int prefetch_window;
     /*
      * Number of postcopy channels including the default precopy channel, so
      * vanilla postcopy will only contain one channel which contain both
@@ -553,6 +562,9 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis, RAMBlock *rb,
                               ram_addr_t start, uint64_t haddr, uint32_t tid);
 int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
                                       RAMBlock *rb, ram_addr_t start);
+int migrate_send_rp_message_req_range(MigrationIncomingState *mis,
+                                      RAMBlock *rb, ram_addr_t start,
+                                      size_t len);
 void migrate_send_rp_recv_bitmap(MigrationIncomingState *mis,
                                  char *block_name);
 void migrate_send_rp_resume_ack(MigrationIncomingState *mis, uint32_t value);
@@ -0,0 +1,242 @@
+/*
+ * Multifd lz4 compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include "qemu/rcu.h"
+#include "system/ramblock.h"
+#include "qemu/bswap.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "multifd.h"
+
+/*
+ * Every page is compressed as an independent lz4 block, preceded by
+ * its compressed length as a big-endian 32-bit value.  A length equal
+ * to the page size means the page did not compress and is sent as-is.
+ *
+ * Pages are not chained with LZ4_compress_fast_continue() on purpose:
+ * the guest keeps writing to them while they are compressed, so the
+ * source side dictionary would not match what the destination decoded.
+ */
+typedef uint32_t lz4_hdr_t;
+
+struct lz4_data {
+    /* compression state, reused for every page */
+    void *state;
+    /* compressed buffer */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+};
+
+static uint32_t multifd_lz4_zbuff_len(void)
+{
+    return multifd_ram_page_count() *
+           (sizeof(lz4_hdr_t) + LZ4_COMPRESSBOUND(multifd_ram_page_size()));
+}
+
+/* Multifd lz4 compression */
+
+static int multifd_lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+    const char *err_msg;
+
+    z->state = g_try_malloc(LZ4_sizeofState());
+    if (!z->state) {
+        err_msg = "out of memory for state";
+        goto err_free_z;
+    }
+    /* This is the maximum size of the compressed buffer */
+    z->zbuff_len = multifd_lz4_zbuff_len();
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        err_msg = "out of memory for zbuff";
+        goto err_free_state;
+    }
+    p->compress_data = z;
+
+    /* Needs 2 IOVs, one for packet header and one for compressed data */
+    p->iov = g_new0(struct iovec, 2);
+    return 0;
+
+err_free_state:
+    g_free(z->state);
+err_free_z:
+    g_free(z);
+    error_setg(errp, "multifd %u: %s", p->id, err_msg);
+    return -1;
+}
+
+static void multifd_lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->compress_data;
+
+    g_free(z->state);
+    z->state = NULL;
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+
+    g_free(p->iov);
+    p->iov = NULL;
+}
+
+static int multifd_lz4_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    struct lz4_data *z = p->compress_data;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t pos = 0;
+    uint32_t i;
+
+    if (!multifd_send_prepare_common(p)) {
+        goto out;
+    }
+
+    for (i = 0; i < pages->normal_num; i++) {
+        const char *src = (const char *)pages->block->host + pages->offset[i];
+        char *dst = (char *)z->zbuff + pos + sizeof(lz4_hdr_t);
+        int ret;
+
+        ret = LZ4_compress_fast_extState(z->state, src, dst, page_size,
+                                         page_size - 1, 1);
+        if (ret <= 0) {
+            /* Did not fit in less than a page, send it uncompressed */
+            memcpy(dst, src, page_size);
+            ret = page_size;
+        }
+        stl_be_p(z->zbuff + pos, ret);
+        pos += sizeof(lz4_hdr_t) + ret;
+    }
+    p->iov[p->iovs_num].iov_base = z->zbuff;
+    p->iov[p->iovs_num].iov_len = pos;
+    p->iovs_num++;
+    p->next_packet_size = pos;
+
+out:
+    p->flags |= MULTIFD_FLAG_LZ4;
+    multifd_send_fill_packet(p);
+    return 0;
+}
+
+static int multifd_lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->zbuff_len = multifd_lz4_zbuff_len();
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for zbuff", p->id);
+        return -1;
+    }
+    p->compress_data = z;
+    return 0;
+}
+
+static void multifd_lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct lz4_data *z = p->compress_data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+}
+
+static int multifd_lz4_recv(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = p->compress_data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t pos = 0;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+
+    multifd_recv_zero_page_process(p);
+
+    if (!p->normal_num) {
+        assert(in_size == 0);
+        return 0;
+    }
+
+    if (in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %u: packet size received %u too big",
+                   p->id, in_size);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *page = p->host + p->normal[i];
+        uint32_t len;
+
+        if (in_size - pos < sizeof(lz4_hdr_t)) {
+            error_setg(errp, "multifd %u: truncated packet", p->id);
+            return -1;
+        }
+        len = ldl_be_p(z->zbuff + pos);
+        pos += sizeof(lz4_hdr_t);
+        if (len > page_size || len > in_size - pos) {
+            error_setg(errp, "multifd %u: invalid page length %u",
+                       p->id, len);
+            return -1;
+        }
+
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+        if (len == page_size) {
+            memcpy(page, z->zbuff + pos, page_size);
+        } else {
+            ret = LZ4_decompress_safe((const char *)z->zbuff + pos,
+                                      (char *)page, len, page_size);
+            if (ret != page_size) {
+                error_setg(errp, "multifd %u: LZ4_decompress_safe "
+                           "returned %d instead of %u", p->id, ret, page_size);
+                return -1;
+            }
+        }
+        pos += len;
+    }
+    if (pos != in_size) {
+        error_setg(errp, "multifd %u: packet size received %u size expected %u",
+                   p->id, in_size, pos);
+        return -1;
+    }
+    return 0;
+}
+
+static const MultiFDMethods multifd_lz4_ops = {
+    .send_setup = multifd_lz4_send_setup,
+    .send_cleanup = multifd_lz4_send_cleanup,
+    .send_prepare = multifd_lz4_send_prepare,
+    .recv_setup = multifd_lz4_recv_setup,
+    .recv_cleanup = multifd_lz4_recv_cleanup,
+    .recv = multifd_lz4_recv
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
@@ -0,0 +1,354 @@
+/*
+ * Multifd XBZRLE delta encoding implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/rcu.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
+#include "system/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "migration-stats.h"
+#include "options.h"
+#include "page_cache.h"
+#include "xbzrle.h"
+#include "multifd.h"
+
+/*
+ * Every normal page is preceded by a big-endian 32-bit length:
+ *
+ *  - 0 means the page did not change since it was last sent;
+ *  - the page size means the page follows uncompressed;
+ *  - anything else is the length of the XBZRLE delta that follows,
+ *    to be applied on top of what the destination already has.
+ *
+ * The destination does not need a cache, its RAM holds the previous
+ * copy.  On the source, the cache must always hold what the destination
+ * has, so it is shared by all channels and updated with the exact bytes
+ * that are sent.  It is sharded by MULTIFD_PACKET_SIZE chunks of RAM so
+ * that a packet usually only takes one shard lock.
+ */
+typedef uint32_t xbzrle_hdr_t;
+
+typedef struct {
+    QemuMutex lock;
+    PageCache *cache;
+} XBZRLEShard;
+
+static struct {
+    XBZRLEShard *shards;
+    unsigned nr_shards;
+    unsigned users;
+} multifd_xbzrle;
+
+struct xbzrle_data {
+    /* stable copy of the page being encoded */
+    uint8_t *current_buf;
+    /* output buffer */
+    uint8_t *zbuff;
+    /* size of output buffer */
+    uint32_t zbuff_len;
+};
+
+static uint32_t multifd_xbzrle_zbuff_len(void)
+{
+    return multifd_ram_page_count() *
+           (sizeof(xbzrle_hdr_t) + multifd_ram_page_size());
+}
+
+static XBZRLEShard *multifd_xbzrle_shard(ram_addr_t addr)
+{
+    return &multifd_xbzrle.shards[(addr / MULTIFD_PACKET_SIZE) %
+                                  multifd_xbzrle.nr_shards];
+}
+
+static void multifd_xbzrle_cache_fini(void)
+{
+    unsigned i;
+
+    for (i = 0; i < multifd_xbzrle.nr_shards; i++) {
+        XBZRLEShard *shard = &multifd_xbzrle.shards[i];
+
+        if (shard->cache) {
+            cache_fini(shard->cache);
+        }
+        qemu_mutex_destroy(&shard->lock);
+    }
+    g_free(multifd_xbzrle.shards);
+    multifd_xbzrle.shards = NULL;
+    multifd_xbzrle.nr_shards = 0;
+}
+
+static bool multifd_xbzrle_cache_init(Error **errp)
+{
+    unsigned nr_shards = migrate_multifd_channels();
+    uint64_t shard_size = pow2floor(migrate_xbzrle_cache_size() / nr_shards);
+    unsigned i;
+
+    multifd_xbzrle.shards = g_new0(XBZRLEShard, nr_shards);
+    multifd_xbzrle.nr_shards = nr_shards;
+    for (i = 0; i < nr_shards; i++) {
+        XBZRLEShard *shard = &multifd_xbzrle.shards[i];
+
+        qemu_mutex_init(&shard->lock);
+        shard->cache = cache_init(shard_size, multifd_ram_page_size(), errp);
+        if (!shard->cache) {
+            multifd_xbzrle_cache_fini();
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Multifd xbzrle delta encoding */
+
+static int multifd_xbzrle_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z;
+
+    /* Setup and cleanup are called for all channels from one thread */
+    if (!multifd_xbzrle.users && !multifd_xbzrle_cache_init(errp)) {
+        error_prepend(errp, "multifd %u: ", p->id);
+        return -1;
+    }
+    multifd_xbzrle.users++;
+
+    z = g_new0(struct xbzrle_data, 1);
+    z->current_buf = g_malloc(multifd_ram_page_size());
+    z->zbuff_len = multifd_xbzrle_zbuff_len();
+    z->zbuff = g_malloc(z->zbuff_len);
+    p->compress_data = z;
+
+    /* Needs 2 IOVs, one for packet header and one for encoded data */
+    p->iov = g_new0(struct iovec, 2);
+    return 0;
+}
+
+static void multifd_xbzrle_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z = p->compress_data;
+
+    g_free(z->current_buf);
+    z->current_buf = NULL;
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+
+    g_free(p->iov);
+    p->iov = NULL;
+
+    if (!--multifd_xbzrle.users) {
+        multifd_xbzrle_cache_fini();
+    }
+}
+
+/*
+ * Encode one page at @dst and return the value of its header.  The
+ * shard lock must be held.  @buf is scratch space for a page.
+ */
+static uint32_t multifd_xbzrle_encode(PageCache *cache, ram_addr_t addr,
+                                      const uint8_t *page, uint8_t *buf,
+                                      uint8_t *dst, uint64_t generation)
+{
+    uint32_t page_size = multifd_ram_page_size();
+    uint8_t *cached;
+    int len;
+
+    /* The guest may write to the page, work on a stable copy */
+    memcpy(buf, page, page_size);
+
+    if (!cache_is_cached(cache, addr, generation)) {
+        cache_insert(cache, addr, buf, generation);
+        memcpy(dst, buf, page_size);
+        return page_size;
+    }
+
+    cached = get_cached_data(cache, addr);
+    len = xbzrle_encode_buffer(cached, buf, page_size, dst, page_size - 1);
+    if (len == 0) {
+        return 0;
+    }
+    memcpy(cached, buf, page_size);
+    if (len < 0) {
+        memcpy(dst, buf, page_size);
+        return page_size;
+    }
+    return len;
+}
+
+static int multifd_xbzrle_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    struct xbzrle_data *z = p->compress_data;
+    uint64_t generation = stat64_get(&mig_stats.dirty_sync_count);
+    uint32_t page_size = multifd_ram_page_size();
+    XBZRLEShard *locked = NULL;
+    bool has_normal;
+    uint32_t pos = 0;
+    uint32_t i;
+
+    has_normal = multifd_send_prepare_common(p);
+
+    for (i = 0; i < pages->num; i++) {
+        ram_addr_t addr = pages->block->offset + pages->offset[i];
+        XBZRLEShard *shard = multifd_xbzrle_shard(addr);
+
+        if (shard != locked) {
+            if (locked) {
+                qemu_mutex_unlock(&locked->lock);
+            }
+            qemu_mutex_lock(&shard->lock);
+            locked = shard;
+        }
+
+        if (i >= pages->normal_num) {
+            /*
+             * Zero pages are sent separately and zeroed on the
+             * destination, the cache must not keep the old contents.
+             */
+            if (cache_is_cached(shard->cache, addr, generation)) {
+                memset(get_cached_data(shard->cache, addr), 0, page_size);
+            }
+        } else {
+            uint8_t *dst = z->zbuff + pos + sizeof(xbzrle_hdr_t);
+            uint32_t len;
+
+            len = multifd_xbzrle_encode(shard->cache, addr,
+                                        pages->block->host + pages->offset[i],
+                                        z->current_buf, dst, generation);
+            stl_be_p(z->zbuff + pos, len);
+            pos += sizeof(xbzrle_hdr_t) + len;
+        }
+    }
+    if (locked) {
+        qemu_mutex_unlock(&locked->lock);
+    }
+
+    if (!has_normal) {
+        goto out;
+    }
+
+    p->iov[p->iovs_num].iov_base = z->zbuff;
+    p->iov[p->iovs_num].iov_len = pos;
+    p->iovs_num++;
+    p->next_packet_size = pos;
+
+out:
+    p->flags |= MULTIFD_FLAG_XBZRLE;
+    multifd_send_fill_packet(p);
+    return 0;
+}
+
+static int multifd_xbzrle_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *z = g_new0(struct xbzrle_data, 1);
+
+    z->zbuff_len = multifd_xbzrle_zbuff_len();
+    z->zbuff = g_malloc(z->zbuff_len);
+    p->compress_data = z;
+    return 0;
+}
+
+static void multifd_xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct xbzrle_data *z = p->compress_data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+}
+
+static int multifd_xbzrle_recv(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *z = p->compress_data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t pos = 0;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_XBZRLE) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_XBZRLE);
+        return -1;
+    }
+
+    multifd_recv_zero_page_process(p);
+
+    if (!p->normal_num) {
+        assert(in_size == 0);
+        return 0;
+    }
+
+    if (in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %u: packet size received %u too big",
+                   p->id, in_size);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *page = p->host + p->normal[i];
+        uint32_t len;
+
+        if (in_size - pos < sizeof(xbzrle_hdr_t)) {
+            error_setg(errp, "multifd %u: truncated packet", p->id);
+            return -1;
+        }
+        len = ldl_be_p(z->zbuff + pos);
+        pos += sizeof(xbzrle_hdr_t);
+        if (len > page_size || len > in_size - pos) {
+            error_setg(errp, "multifd %u: invalid page length %u",
+                       p->id, len);
+            return -1;
+        }
+
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+        if (len == page_size) {
+            memcpy(page, z->zbuff + pos, page_size);
+        } else if (len) {
+            ret = xbzrle_decode_buffer(z->zbuff + pos, len, page, page_size);
+            if (ret < 0) {
+                error_setg(errp, "multifd %u: failed to decode XBZRLE page",
+                           p->id);
+                return -1;
+            }
+        }
+        pos += len;
+    }
+    if (pos != in_size) {
+        error_setg(errp, "multifd %u: packet size received %u size expected %u",
+                   p->id, in_size, pos);
+        return -1;
+    }
+    return 0;
+}
+
+static const MultiFDMethods multifd_xbzrle_ops = {
+    .send_setup = multifd_xbzrle_send_setup,
+    .send_cleanup = multifd_xbzrle_send_cleanup,
+    .send_prepare = multifd_xbzrle_send_prepare,
+    .recv_setup = multifd_xbzrle_recv_setup,
+    .recv_cleanup = multifd_xbzrle_recv_cleanup,
+    .recv = multifd_xbzrle_recv
+};
+
+static void multifd_xbzrle_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_XBZRLE, &multifd_xbzrle_ops);
+}
+
+migration_init(multifd_xbzrle_register);
@@ -24,24 +24,14 @@ static bool multifd_zero_page_enabled(void)
     return migrate_zero_page_detection() == ZERO_PAGE_DETECTION_MULTIFD;
 }
 
-static void swap_page_offset(ram_addr_t *pages_offset, int a, int b)
-{
-    ram_addr_t temp;
-
-    if (a == b) {
-        return;
-    }
-
-    temp = pages_offset[a];
-    pages_offset[a] = pages_offset[b];
-    pages_offset[b] = temp;
-}
+/* Number of pages checked together by buffer_is_zero_batch() */
+#define MULTIFD_ZERO_SCAN_BATCH 64
 
 /**
  * multifd_send_zero_page_detect: Perform zero page detection on all pages.
  *
  * Sorts normal pages before zero pages in p->pages->offset and updates
- * p->pages->normal_num.
+ * p->pages->normal_num.  Normal pages keep their order.
  *
  * @param p A pointer to the send params.
  */
@@ -49,8 +39,9 @@ void multifd_send_zero_page_detect(MultiFDSendParams *p)
 {
     MultiFDPages_t *pages = &p->data->u.ram;
     RAMBlock *rb = pages->block;
-    int i = 0;
-    int j = pages->num - 1;
+    const void *bufs[MULTIFD_ZERO_SCAN_BATCH];
+    bool zero[MULTIFD_ZERO_SCAN_BATCH];
+    uint32_t normal = 0, end = 0, i;
 
     if (!multifd_zero_page_enabled()) {
         pages->normal_num = pages->num;
@@ -58,23 +49,34 @@ void multifd_send_zero_page_detect(MultiFDSendParams *p)
     }
 
     /*
-     * Sort the page offset array by moving all normal pages to
-     * the left and all zero pages to the right of the array.
+     * Scan the pages a batch at a time.  The array is kept as normal
+     * pages in [0, normal), zero pages in [normal, end), and pages not
+     * looked at yet from end on.  The batch is copied out first, so its
+     * slots are free to receive the zero pages that a normal page
+     * displaces.
      */
-    while (i <= j) {
-        uint64_t offset = pages->offset[i];
+    while (end < pages->num) {
+        uint32_t n = MIN(pages->num - end, MULTIFD_ZERO_SCAN_BATCH);
+        ram_addr_t batch[MULTIFD_ZERO_SCAN_BATCH];
 
-        if (!buffer_is_zero(rb->host + offset, multifd_ram_page_size())) {
-            i++;
-            continue;
+        for (i = 0; i < n; i++) {
+            batch[i] = pages->offset[end + i];
+            bufs[i] = rb->host + batch[i];
         }
+        buffer_is_zero_batch(bufs, n, multifd_ram_page_size(), zero);
 
-        swap_page_offset(pages->offset, i, j);
-        ram_release_page(rb->idstr, offset);
-        j--;
+        for (i = 0; i < n; i++) {
+            if (zero[i]) {
+                pages->offset[end++] = batch[i];
+                ram_release_page(rb->idstr, batch[i]);
+            } else {
+                pages->offset[end++] = pages->offset[normal];
+                pages->offset[normal++] = batch[i];
+            }
+        }
     }
 
-    pages->normal_num = i;
+    pages->normal_num = normal;
 
 out:
     stat64_add(&mig_stats.normal_pages, pages->normal_num);
@@ -103,7 +105,12 @@ void multifd_recv_zero_page_process(MultiFDRecvParams *p)
          * it is migrated.
          */
         if (migrate_postcopy_ram() || received) {
-            memset(page, 0, multifd_ram_page_size());
+            /*
+             * Reading fresh anonymous memory maps the shared zero page,
+             * which is enough to populate it, so only write to it when
+             * it is not zero already.
+             */
+            ram_handle_zero(page, multifd_ram_page_size());
         }
         if (!received) {
             ramblock_recv_bitmap_set_offset(p->block, p->zero[i]);
@@ -595,32 +595,27 @@ void multifd_send_shutdown(void)
     multifd_send_cleanup_state();
 }
 
-static int multifd_zero_copy_flush(QIOChannel *c)
+static int multifd_zero_copy_flush(QIOChannel *c, Error **errp)
 {
     int ret;
-    Error *err = NULL;
 
-    ret = qio_channel_flush(c, &err);
+    ret = qio_channel_flush(c, errp);
     if (ret < 0) {
-        error_report_err(err);
         return -1;
     }
     if (ret == 1) {
         stat64_add(&mig_stats.dirty_sync_missed_zero_copy, 1);
     }
 
-    return ret;
+    return 0;
 }
 
 int multifd_send_sync_main(MultiFDSyncReq req)
 {
     int i;
-    bool flush_zero_copy;
 
     assert(req != MULTIFD_SYNC_NONE);
 
-    flush_zero_copy = migrate_zero_copy_send();
-
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
 
@@ -648,10 +643,14 @@ int multifd_send_sync_main(MultiFDSyncReq req)
         qemu_sem_wait(&multifd_send_state->channels_ready);
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
+    }
 
-        if (flush_zero_copy && p->c && (multifd_zero_copy_flush(p->c) < 0)) {
-            return -1;
-        }
+    /*
+     * A channel that failed, e.g. to flush its zero-copy sends, only
+     * kicks sem_sync; do not report the sync as done.
+     */
+    if (multifd_send_should_exit()) {
+        return -1;
     }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 
@@ -768,6 +767,18 @@ static void *multifd_send_thread(void *opaque)
                 stat64_add(&mig_stats.multifd_bytes, p->packet_len);
             }
 
+            /*
+             * Wait for the zero copy sends to complete here rather than
+             * in multifd_send_sync_main(), so that all channels do it
+             * in parallel.
+             */
+            if (migrate_zero_copy_send()) {
+                ret = multifd_zero_copy_flush(p->c, &local_err);
+                if (ret != 0) {
+                    break;
+                }
+            }
+
             qatomic_set(&p->pending_sync, MULTIFD_SYNC_NONE);
             qemu_sem_post(&p->sem_sync);
         }
@@ -66,6 +66,8 @@ MultiFDRecvData *multifd_get_recv_data(void);
 #define MULTIFD_FLAG_QPL (4 << 1)
 #define MULTIFD_FLAG_UADK (8 << 1)
 #define MULTIFD_FLAG_QATZIP (16 << 1)
+#define MULTIFD_FLAG_LZ4 (3 << 1)
+#define MULTIFD_FLAG_XBZRLE (5 << 1)
 
 /*
  * If set it means that this packet contains device state
@@ -134,6 +136,8 @@ struct MultiFDRecvData {
     size_t size;
     /* for preadv */
     off_t file_offset;
+    /* zero the range instead of reading it from file_offset */
+    bool zero;
 };
 
 typedef struct {
@@ -203,6 +203,12 @@ const Property migration_properties[] = {
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
     DEFINE_PROP_MIG_CAP("mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("x-defer-hot-pages",
+                        MIGRATION_CAPABILITY_X_DEFER_HOT_PAGES),
+    DEFINE_PROP_MIG_CAP("x-dirty-limit-adaptive",
+                        MIGRATION_CAPABILITY_X_DIRTY_LIMIT_ADAPTIVE),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram-incremental",
+                        MIGRATION_CAPABILITY_X_MAPPED_RAM_INCREMENTAL),
 };
 const size_t migration_properties_count = ARRAY_SIZE(migration_properties);
 
@@ -241,6 +247,13 @@ bool migrate_dirty_bitmaps(void)
     return s->capabilities[MIGRATION_CAPABILITY_DIRTY_BITMAPS];
 }
 
+bool migrate_defer_hot_pages(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_DEFER_HOT_PAGES];
+}
+
 bool migrate_dirty_limit(void)
 {
     MigrationState *s = migrate_get_current();
@@ -248,6 +261,13 @@ bool migrate_dirty_limit(void)
     return s->capabilities[MIGRATION_CAPABILITY_DIRTY_LIMIT];
 }
 
+bool migrate_dirty_limit_adaptive(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_DIRTY_LIMIT_ADAPTIVE];
+}
+
 bool migrate_events(void)
 {
     MigrationState *s = migrate_get_current();
@@ -262,6 +282,13 @@ bool migrate_mapped_ram(void)
     return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
 }
 
+bool migrate_mapped_ram_incremental(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_X_MAPPED_RAM_INCREMENTAL];
+}
+
 bool migrate_ignore_shared(void)
 {
     MigrationState *s = migrate_get_current();
@@ -443,7 +470,10 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_XBZRLE,
     MIGRATION_CAPABILITY_X_COLO,
     MIGRATION_CAPABILITY_VALIDATE_UUID,
-    MIGRATION_CAPABILITY_ZERO_COPY_SEND);
+    MIGRATION_CAPABILITY_ZERO_COPY_SEND,
+    MIGRATION_CAPABILITY_X_DEFER_HOT_PAGES,
+    MIGRATION_CAPABILITY_X_DIRTY_LIMIT_ADAPTIVE,
+    MIGRATION_CAPABILITY_X_MAPPED_RAM_INCREMENTAL);
 
 /* Snapshot compatibility check list */
 static const
@@ -631,6 +661,18 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_X_DIRTY_LIMIT_ADAPTIVE] &&
+        !new_caps[MIGRATION_CAPABILITY_DIRTY_LIMIT]) {
+        error_setg(errp, "x-dirty-limit-adaptive requires dirty-limit");
+        return false;
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_X_MAPPED_RAM_INCREMENTAL] &&
+        !new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        error_setg(errp, "x-mapped-ram-incremental requires mapped-ram");
+        return false;
+    }
+
     if (new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
         if (new_caps[MIGRATION_CAPABILITY_XBZRLE]) {
             error_setg(errp, "Multifd is not compatible with xbzrle");
@@ -703,6 +745,10 @@ void qmp_migrate_set_capabilities(MigrationCapabilityStatusList *params,
     for (cap = params; cap; cap = cap->next) {
         s->capabilities[cap->value->capability] = cap->value->state;
     }
+
+    if (!migrate_mapped_ram_incremental()) {
+        ram_incremental_drop_base();
+    }
 }
 
 /* parameters */
@@ -1181,6 +1227,13 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
     }
 #endif
 
+    if (params->multifd_compression == MULTIFD_COMPRESSION_XBZRLE &&
+        params->zero_page_detection == ZERO_PAGE_DETECTION_LEGACY) {
+        error_setg(errp, "multifd xbzrle compression is not compatible "
+                   "with legacy zero page detection");
+        return false;
+    }
+
     if (migrate_mapped_ram() &&
         (migrate_multifd_compression() || migrate_tls())) {
         error_setg(errp,
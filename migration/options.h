@@ -27,9 +27,12 @@ extern const size_t migration_properties_count;
 
 bool migrate_auto_converge(void);
 bool migrate_colo(void);
+bool migrate_defer_hot_pages(void);
 bool migrate_dirty_bitmaps(void);
+bool migrate_dirty_limit_adaptive(void);
 bool migrate_events(void);
 bool migrate_mapped_ram(void);
+bool migrate_mapped_ram_incremental(void);
 bool migrate_ignore_shared(void);
 bool migrate_late_block_activate(void);
 bool migrate_multifd(void);
@@ -18,6 +18,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/madvise.h"
+#include "qemu/units.h"
 #include "exec/target_page.h"
 #include "migration.h"
 #include "qemu-file.h"
@@ -949,6 +950,65 @@ int postcopy_wake_shared(struct PostCopyFD *pcfd,
                        pagesize);
 }
 
+/* Upper bound of the prefetch window, in bytes */
+#define POSTCOPY_PREFETCH_MAX   (1 * MiB)
+
+/*
+ * Guests often fault pages in sequentially, e.g. when copying or zeroing
+ * a buffer.  When a fault lands right after the previous one, or within
+ * the range prefetched along with it, ask the source for the following
+ * pages too.  The window doubles on every sequential fault and is reset
+ * on the first random one.  The source skips the pages it already sent,
+ * so a prefetch that races with the background stream costs little.
+ *
+ * Prefetched pages are not tracked in page_requested: nothing waits on
+ * them, and they need not be requested again after a recovery.
+ *
+ * Not done with postcopy-preempt: the source sends every requested range
+ * synchronously on the preempt channel, so the next real fault would wait
+ * behind the whole prefetch.
+ */
+static void postcopy_prefetch_pages(MigrationIncomingState *mis,
+                                    RAMBlock *rb, ram_addr_t start)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    unsigned int max = POSTCOPY_PREFETCH_MAX / pagesize;
+    ram_addr_t begin = start + pagesize, end;
+
+    if (migrate_postcopy_preempt()) {
+        return;
+    }
+
+    if (rb == mis->prefetch_rb && start > mis->prefetch_last &&
+        start <= mis->prefetch_end) {
+        mis->prefetch_window = MIN(MAX(mis->prefetch_window * 2, 1), max);
+    } else {
+        mis->prefetch_window = 0;
+    }
+    mis->prefetch_rb = rb;
+    mis->prefetch_last = start;
+    mis->prefetch_end = begin;
+
+    if (!mis->prefetch_window) {
+        return;
+    }
+
+    /* Skip what is already there, the source would reply to nothing */
+    while (begin < rb->postcopy_length &&
+           ramblock_recv_bitmap_test_byte_offset(rb, begin)) {
+        begin += pagesize;
+    }
+    end = MIN(begin + (ram_addr_t)mis->prefetch_window * pagesize,
+              rb->postcopy_length);
+    mis->prefetch_end = MAX(end, start + pagesize);
+    if (begin >= end) {
+        return;
+    }
+
+    trace_postcopy_prefetch_pages(qemu_ram_get_idstr(rb), begin, end - begin);
+    migrate_send_rp_message_req_range(mis, rb, begin, end - begin);
+}
+
 /*
  * NOTE: @tid is only used when postcopy-blocktime feature is enabled, and
  * also optional: when zero is provided, the fault accounting will be ignored.
@@ -957,6 +1017,7 @@ static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
                                  ram_addr_t start, uint64_t haddr, uint32_t tid)
 {
     void *aligned = (void *)(uintptr_t)ROUND_DOWN(haddr, qemu_ram_pagesize(rb));
+    int ret;
 
     /*
      * Discarded pages (via RamDiscardManager) are never migrated. On unlikely
@@ -973,7 +1034,11 @@ static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
         return received ? 0 : postcopy_place_page_zero(mis, aligned, rb);
     }
 
-    return migrate_send_rp_req_pages(mis, rb, start, haddr, tid);
+    ret = migrate_send_rp_req_pages(mis, rb, start, haddr, tid);
+    if (!ret) {
+        postcopy_prefetch_pages(mis, rb, start);
+    }
+    return ret;
 }
 
 /*
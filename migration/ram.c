@@ -28,6 +28,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
@@ -57,7 +58,9 @@
 #include "system/ramblock.h"
 #include "savevm.h"
 #include "qemu/iov.h"
+#include "block/thread-pool.h"
 #include "multifd.h"
+#include "file.h"
 #include "system/runstate.h"
 #include "rdma.h"
 #include "options.h"
@@ -65,6 +68,7 @@
 #include "system/kvm.h"
 
 #include "hw/boards.h" /* for machine_dump_guest_core() */
+#include "hw/core/cpu.h"
 
 #if defined(__linux__)
 #include "qemu/userfaultfd.h"
@@ -391,6 +395,25 @@ struct RAMState {
     uint64_t bytes_xfer_prev;
     /* number of dirty pages since start_time */
     uint64_t num_dirty_pages_period;
+    /* Did the current search skip hot pages? */
+    bool hot_pages_skipped;
+    /*
+     * Set when a full pass over RAM only found hot pages, cleared by
+     * the next bitmap sync.
+     */
+    bool hot_pages_deferred;
+    /* Has every page been sent once, so that hot ones can be deferred? */
+    bool hot_pages_ready;
+    /* Deferring hot pages kept the migration from converging */
+    bool hot_pages_off;
+    /*
+     * Only send the pages dirtied since the previous migration, which
+     * wrote the rest of the mapped-ram file already.
+     */
+    bool incremental;
+    /* workers splitting the bitmap sync of large RAMBlocks, or NULL */
+    ThreadPool *sync_threads;
+    int sync_nr_threads;
     /* xbzrle misses since the beginning of the period */
     uint64_t xbzrle_cache_miss_prev;
     /* Amount of xbzrle pages since the beginning of the period */
@@ -440,6 +463,12 @@ typedef struct RAMState RAMState;
 
 static RAMState *ram_state;
 
+/*
+ * The dirty log was left running by a completed migration with
+ * x-mapped-ram-incremental, see ram_incremental_keep_dirty_log().
+ */
+static bool ram_incremental_base;
+
 static NotifierWithReturnList precopy_notifier_list;
 
 /* Whether postcopy has queued requests? */
@@ -937,8 +966,206 @@ bool ramblock_page_is_discarded(RAMBlock *rb, ram_addr_t start)
     return false;
 }
 
+/*
+ * Page hotness is tracked per chunk of 1 << RAM_HOT_CHUNK_SHIFT target
+ * pages.  With x-defer-hot-pages, chunks that were dirtied in at least
+ * RAM_HOT_THRESHOLD consecutive syncs are left for the stop-and-copy
+ * phase, as long as their dirty pages fit in the downtime limit.
+ */
+#define RAM_HOT_CHUNK_SHIFT 9
+#define RAM_HOT_CHUNK_WORDS ((1UL << RAM_HOT_CHUNK_SHIFT) / BITS_PER_LONG)
+#define RAM_HOT_THRESHOLD   3
+
+static void ram_hotness_update(uint8_t *hotness, unsigned long chunk,
+                               bool dirty)
+{
+    if (!dirty) {
+        hotness[chunk] = 0;
+    } else if (hotness[chunk] < UINT8_MAX) {
+        hotness[chunk]++;
+    }
+}
+
+static bool ram_page_deferred(RAMState *rs, RAMBlock *rb, unsigned long page)
+{
+    return rb->hot_bmap && !rs->hot_pages_off && !rs->last_stage &&
+           !migration_in_postcopy() &&
+           test_bit(page >> RAM_HOT_CHUNK_SHIFT, rb->hot_bmap);
+}
+
+/*
+ * Pick the hot chunks that find_dirty_block() skips until the next sync.
+ * Their dirty pages are capped at what can be sent within the downtime
+ * limit, so that the deferred pages never keep the migration from
+ * converging on their own.  Nothing is deferred before every page has
+ * been sent once.
+ *
+ * Called with RCU critical section and bitmap_mutex held
+ */
+static void ram_hot_pages_select(RAMState *rs)
+{
+    uint64_t budget = migrate_get_current()->threshold_size >>
+                      TARGET_PAGE_BITS;
+    RAMBlock *block;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+        unsigned long chunks = DIV_ROUND_UP(pages,
+                                            1UL << RAM_HOT_CHUNK_SHIFT);
+        unsigned long i;
+
+        if (!block->hot_bmap) {
+            continue;
+        }
+        bitmap_zero(block->hot_bmap, chunks);
+        if (!rs->hot_pages_ready || rs->hot_pages_off) {
+            continue;
+        }
+        for (i = 0; i < chunks && budget; i++) {
+            unsigned long start = i << RAM_HOT_CHUNK_SHIFT;
+            uint64_t dirty;
+
+            if (block->hotness[i] < RAM_HOT_THRESHOLD) {
+                continue;
+            }
+            dirty = bitmap_count_one_with_offset(block->bmap, start,
+                        MIN(1UL << RAM_HOT_CHUNK_SHIFT, pages - start));
+            if (dirty <= budget) {
+                set_bit(i, block->hot_bmap);
+                budget -= dirty;
+            }
+        }
+    }
+}
+
+/*
+ * Merge the global dirty bitmap into rb->bmap for a range whose start
+ * and length are aligned to a bitmap word.  Distinct ranges touch
+ * distinct words of both bitmaps, so they can be merged concurrently
+ * as long as they are also aligned to a hotness chunk.
+ *
+ * Called with RCU critical section
+ */
+static uint64_t physical_memory_sync_dirty_words(RAMBlock *rb,
+                                                 ram_addr_t start,
+                                                 ram_addr_t length)
+{
+    unsigned long word = BIT_WORD((start + rb->offset) >> TARGET_PAGE_BITS);
+    uint64_t num_dirty = 0;
+    unsigned long *dest = rb->bmap;
+    unsigned long k;
+    unsigned long nr = BITS_TO_LONGS(length >> TARGET_PAGE_BITS);
+    unsigned long * const *src;
+    unsigned long idx = (word * BITS_PER_LONG) / DIRTY_MEMORY_BLOCK_SIZE;
+    unsigned long offset = BIT_WORD((word * BITS_PER_LONG) %
+                                    DIRTY_MEMORY_BLOCK_SIZE);
+    unsigned long page = BIT_WORD(start >> TARGET_PAGE_BITS);
+    unsigned long hot_chunk = page / RAM_HOT_CHUNK_WORDS;
+    bool hot_dirty = false;
+
+    src = qatomic_rcu_read(
+            &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
+
+    for (k = page; k < page + nr; k++) {
+        unsigned long bits = 0;
+
+        if (src[idx][offset]) {
+            unsigned long new_dirty;
+            bits = qatomic_xchg(&src[idx][offset], 0);
+            new_dirty = ~dest[k];
+            dest[k] |= bits;
+            new_dirty &= bits;
+            num_dirty += ctpopl(new_dirty);
+        }
+
+        if (rb->hotness) {
+            if (k / RAM_HOT_CHUNK_WORDS != hot_chunk) {
+                ram_hotness_update(rb->hotness, hot_chunk, hot_dirty);
+                hot_chunk = k / RAM_HOT_CHUNK_WORDS;
+                hot_dirty = false;
+            }
+            hot_dirty |= bits != 0;
+        }
+
+        if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
+            offset = 0;
+            idx++;
+        }
+    }
+    if (rb->hotness && nr) {
+        ram_hotness_update(rb->hotness, hot_chunk, hot_dirty);
+    }
+
+    return num_dirty;
+}
+
+/* Do not bother splitting the sync in pieces smaller than this */
+#define RAM_SYNC_CHUNK_MIN (256 * MiB)
+
+typedef struct {
+    RAMBlock *rb;
+    ram_addr_t start;
+    ram_addr_t length;
+    uint64_t num_dirty;
+} RAMSyncChunk;
+
+static int ram_sync_chunk_func(void *opaque)
+{
+    RAMSyncChunk *chunk = opaque;
+
+    /*
+     * The worker is not an RCU reader, the dirty memory blocks are kept
+     * alive by the RCU critical section of the thread waiting for us.
+     */
+    chunk->num_dirty = physical_memory_sync_dirty_words(chunk->rb,
+                                                        chunk->start,
+                                                        chunk->length);
+    return 0;
+}
+
 /* Called with RCU critical section */
-static uint64_t physical_memory_sync_dirty_bitmap(RAMBlock *rb,
+static uint64_t physical_memory_sync_dirty_words_parallel(RAMState *rs,
+                                                          RAMBlock *rb,
+                                                          ram_addr_t start,
+                                                          ram_addr_t length)
+{
+    ram_addr_t align = (ram_addr_t)1 << (RAM_HOT_CHUNK_SHIFT +
+                                         TARGET_PAGE_BITS);
+    ram_addr_t size = MAX(ROUND_UP(DIV_ROUND_UP(length, rs->sync_nr_threads),
+                                   align), RAM_SYNC_CHUNK_MIN);
+    g_autofree RAMSyncChunk *chunks = NULL;
+    uint64_t num_dirty = 0;
+    int i, n;
+
+    if (!rs->sync_threads || length <= RAM_SYNC_CHUNK_MIN) {
+        return physical_memory_sync_dirty_words(rb, start, length);
+    }
+
+    n = DIV_ROUND_UP(length, size);
+    chunks = g_new(RAMSyncChunk, n);
+    for (i = 0; i < n; i++) {
+        chunks[i].rb = rb;
+        chunks[i].start = start + i * size;
+        chunks[i].length = MIN(size, length - i * size);
+        chunks[i].num_dirty = 0;
+        /* Leave a piece for this thread, it would be idle otherwise */
+        if (i) {
+            thread_pool_submit(rs->sync_threads, ram_sync_chunk_func,
+                               &chunks[i], NULL);
+        }
+    }
+    ram_sync_chunk_func(&chunks[0]);
+    thread_pool_wait(rs->sync_threads);
+
+    for (i = 0; i < n; i++) {
+        num_dirty += chunks[i].num_dirty;
+    }
+    return num_dirty;
+}
+
+/* Called with RCU critical section */
+static uint64_t physical_memory_sync_dirty_bitmap(RAMState *rs,
+                                                  RAMBlock *rb,
                                                   ram_addr_t start,
                                                   ram_addr_t length)
 {
@@ -951,32 +1178,8 @@ static uint64_t physical_memory_sync_dirty_bitmap(RAMBlock *rb,
     if (((word * BITS_PER_LONG) << TARGET_PAGE_BITS) ==
          (start + rb->offset) &&
         !(length & ((BITS_PER_LONG << TARGET_PAGE_BITS) - 1))) {
-        int k;
-        int nr = BITS_TO_LONGS(length >> TARGET_PAGE_BITS);
-        unsigned long * const *src;
-        unsigned long idx = (word * BITS_PER_LONG) / DIRTY_MEMORY_BLOCK_SIZE;
-        unsigned long offset = BIT_WORD((word * BITS_PER_LONG) %
-                                        DIRTY_MEMORY_BLOCK_SIZE);
-        unsigned long page = BIT_WORD(start >> TARGET_PAGE_BITS);
-
-        src = qatomic_rcu_read(
-                &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
-
-        for (k = page; k < page + nr; k++) {
-            if (src[idx][offset]) {
-                unsigned long bits = qatomic_xchg(&src[idx][offset], 0);
-                unsigned long new_dirty;
-                new_dirty = ~dest[k];
-                dest[k] |= bits;
-                new_dirty &= bits;
-                num_dirty += ctpopl(new_dirty);
-            }
-
-            if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
-                offset = 0;
-                idx++;
-            }
-        }
+        num_dirty = physical_memory_sync_dirty_words_parallel(rs, rb,
+                                                              start, length);
         if (num_dirty) {
             physical_memory_dirty_bits_cleared(start, length);
         }
@@ -995,18 +1198,33 @@ static uint64_t physical_memory_sync_dirty_bitmap(RAMBlock *rb,
         }
     } else {
         ram_addr_t offset = rb->offset;
+        unsigned long hot_chunk = start >> (TARGET_PAGE_BITS +
+                                            RAM_HOT_CHUNK_SHIFT);
+        bool hot_dirty = false;
 
         for (addr = 0; addr < length; addr += TARGET_PAGE_SIZE) {
-            if (physical_memory_test_and_clear_dirty(
-                        start + addr + offset,
-                        TARGET_PAGE_SIZE,
-                        DIRTY_MEMORY_MIGRATION)) {
-                long k = (start + addr) >> TARGET_PAGE_BITS;
-                if (!test_and_set_bit(k, dest)) {
-                    num_dirty++;
+            long k = (start + addr) >> TARGET_PAGE_BITS;
+            bool dirty = physical_memory_test_and_clear_dirty(
+                                start + addr + offset,
+                                TARGET_PAGE_SIZE,
+                                DIRTY_MEMORY_MIGRATION);
+
+            if (dirty && !test_and_set_bit(k, dest)) {
+                num_dirty++;
+            }
+
+            if (rb->hotness) {
+                if (k >> RAM_HOT_CHUNK_SHIFT != hot_chunk) {
+                    ram_hotness_update(rb->hotness, hot_chunk, hot_dirty);
+                    hot_chunk = k >> RAM_HOT_CHUNK_SHIFT;
+                    hot_dirty = false;
                 }
+                hot_dirty |= dirty;
             }
         }
+        if (rb->hotness && length) {
+            ram_hotness_update(rb->hotness, hot_chunk, hot_dirty);
+        }
     }
 
     return num_dirty;
@@ -1016,7 +1234,7 @@ static uint64_t physical_memory_sync_dirty_bitmap(RAMBlock *rb,
 static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
 {
     uint64_t new_dirty_pages =
-        physical_memory_sync_dirty_bitmap(rb, 0, rb->used_length);
+        physical_memory_sync_dirty_bitmap(rs, rb, 0, rb->used_length);
 
     rs->migration_dirty_pages += new_dirty_pages;
     rs->num_dirty_pages_period += new_dirty_pages;
@@ -1113,6 +1331,87 @@ static void migration_dirty_limit_guest(void)
     trace_migration_dirty_limit_guest(quota_dirtyrate);
 }
 
+typedef struct {
+    int cpu_index;
+    uint64_t rate;
+} VcpuDirtyRate;
+
+static int vcpu_dirty_rate_cmp(const void *a, const void *b)
+{
+    const VcpuDirtyRate *ra = a, *rb = b;
+
+    return ra->rate < rb->rate ? -1 : ra->rate > rb->rate;
+}
+
+/*
+ * Split a dirty page rate budget between the vCPUs and limit only the
+ * ones that dirty memory faster than their share.
+ *
+ * The budget is what the guest may dirty for the migration to converge:
+ * throttle-trigger-threshold percent of the bandwidth of the last
+ * period.  It is shared by water-filling: vCPUs below an equal share of
+ * what is left keep their rate, the others are all capped to the same
+ * rate, which is the largest one that makes the total fit.  vCPUs that
+ * are not capped get the whole budget as their limit, which keeps the
+ * per-vCPU rate measurement of the dirty limit running without slowing
+ * them down.
+ *
+ * This only runs while the migration does not converge.  Capped vCPUs
+ * then report their cap as their rate, so the next split lowers the
+ * caps further until the total fits in the budget.
+ */
+static void migration_dirty_limit_adaptive(uint64_t bytes_xfer_period,
+                                           uint64_t threshold,
+                                           int64_t period_ms)
+{
+    uint64_t budget, left, cap = UINT64_MAX;
+    g_autofree VcpuDirtyRate *rates = NULL;
+    int nvcpus = 0, i;
+    CPUState *cpu;
+
+    budget = bytes_xfer_period * threshold / 100 * 1000 / period_ms / MiB;
+    budget = MAX(budget, 1);
+    stat64_set(&mig_stats.dirty_limit_budget, budget);
+
+    if (!dirtylimit_in_service()) {
+        /* Start measuring per-vCPU dirty rates, then split next time */
+        qmp_set_vcpu_dirty_limit(false, -1, budget, NULL);
+        trace_migration_dirty_limit_guest(budget);
+        return;
+    }
+
+    CPU_FOREACH(cpu) {
+        nvcpus++;
+    }
+    rates = g_new(VcpuDirtyRate, nvcpus);
+    i = 0;
+    CPU_FOREACH(cpu) {
+        rates[i].cpu_index = cpu->cpu_index;
+        rates[i].rate = MAX(vcpu_dirty_rate_get(cpu->cpu_index), 0);
+        i++;
+    }
+    qsort(rates, nvcpus, sizeof(*rates), vcpu_dirty_rate_cmp);
+
+    left = budget;
+    for (i = 0; i < nvcpus; i++) {
+        uint64_t share = left / (nvcpus - i);
+
+        if (rates[i].rate > share) {
+            cap = MAX(share, 1);
+            break;
+        }
+        left -= rates[i].rate;
+    }
+
+    for (i = 0; i < nvcpus; i++) {
+        uint64_t limit = rates[i].rate >= cap ? cap : budget;
+
+        qmp_set_vcpu_dirty_limit(true, rates[i].cpu_index, limit, NULL);
+        trace_migration_dirty_limit_vcpu(rates[i].cpu_index, rates[i].rate,
+                                         limit);
+    }
+}
+
 static void migration_trigger_throttle(RAMState *rs)
 {
     uint64_t threshold = migrate_throttle_trigger_threshold();
@@ -1135,6 +1434,10 @@ static void migration_trigger_throttle(RAMState *rs)
             trace_migration_throttle();
             mig_throttle_guest_down(bytes_dirty_period,
                                     bytes_dirty_threshold);
+        } else if (migrate_dirty_limit_adaptive()) {
+            migration_dirty_limit_adaptive(bytes_xfer_period, threshold,
+                qemu_clock_get_ms(QEMU_CLOCK_REALTIME) -
+                rs->time_last_bitmap_sync);
         } else if (migrate_dirty_limit()) {
             migration_dirty_limit_guest();
         }
@@ -1145,6 +1448,7 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 {
     RAMBlock *block;
     int64_t end_time;
+    int64_t t0, t1;
 
     stat64_add(&mig_stats.dirty_sync_count, 1);
 
@@ -1153,16 +1457,23 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
     }
 
     trace_migration_bitmap_sync_start();
+    rs->hot_pages_deferred = false;
+    t0 = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     memory_global_dirty_log_sync(last_stage);
+    t1 = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    stat64_set(&mig_stats.dirty_sync_log_time, t1 - t0);
 
     WITH_QEMU_LOCK_GUARD(&rs->bitmap_mutex) {
         WITH_RCU_READ_LOCK_GUARD() {
             RAMBLOCK_FOREACH_NOT_IGNORED(block) {
                 ramblock_sync_dirty_bitmap(rs, block);
             }
+            ram_hot_pages_select(rs);
             stat64_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
         }
     }
+    stat64_set(&mig_stats.dirty_sync_bitmap_time,
+               qemu_clock_get_us(QEMU_CLOCK_REALTIME) - t1);
 
     memory_global_after_dirty_log_sync();
     trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
@@ -1383,12 +1694,23 @@ static int find_dirty_block(RAMState *rs, PageSearchStatus *pss)
     /* Update pss->page for the next dirty bit in ramblock */
     pss_find_next_dirty(pss);
 
+    while (offset_in_ramblock(pss->block,
+                              ((ram_addr_t)pss->page) << TARGET_PAGE_BITS) &&
+           ram_page_deferred(rs, pss->block, pss->page)) {
+        rs->hot_pages_skipped = true;
+        pss->page = (pss->page | ((1UL << RAM_HOT_CHUNK_SHIFT) - 1)) + 1;
+        pss_find_next_dirty(pss);
+    }
+
     if (pss->complete_round && pss->block == rs->last_seen_block &&
         pss->page >= rs->last_page) {
         /*
          * We've been once around the RAM and haven't found anything.
          * Give up.
          */
+        if (rs->hot_pages_skipped) {
+            rs->hot_pages_deferred = true;
+        }
         return PAGE_ALL_CLEAN;
     }
     if (!offset_in_ramblock(pss->block,
@@ -1409,6 +1731,8 @@ static int find_dirty_block(RAMState *rs, PageSearchStatus *pss)
             pss->block = QLIST_FIRST_RCU(&ram_list.blocks);
             /* Flag that we've looped */
             pss->complete_round = true;
+            /* Every page was sent once, hot ones can wait from now on */
+            rs->hot_pages_ready = true;
             /* After the first round, enable XBZRLE. */
             if (migrate_xbzrle()) {
                 rs->xbzrle_started = true;
@@ -2361,6 +2685,7 @@ static int ram_find_and_save_block(RAMState *rs)
     }
 
     pss_init(pss, next_block, next_page);
+    rs->hot_pages_skipped = false;
 
     while (true){
         if (!get_queued_page(rs, pss)) {
@@ -2432,6 +2757,7 @@ static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
         migration_page_queue_free(*rsp);
+        g_clear_pointer(&(*rsp)->sync_threads, thread_pool_free);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
         g_free(*rsp);
@@ -2466,6 +2792,48 @@ static void ram_bitmaps_destroy(void)
         block->bmap = NULL;
         g_free(block->file_bmap);
         block->file_bmap = NULL;
+        g_free(block->hotness);
+        block->hotness = NULL;
+        g_free(block->hot_bmap);
+        block->hot_bmap = NULL;
+    }
+}
+
+/*
+ * Leave the dirty log running after a completed migration to a mapped-ram
+ * file, so that the next migration to the same file only writes the
+ * pages that were dirtied in between.
+ */
+static void ram_incremental_keep_dirty_log(void)
+{
+    RAMBlock *block;
+
+    /*
+     * Chunks whose dirty log was synced but not cleared yet would not
+     * log the writes that come next.  Everything was sent, clear them.
+     */
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            migration_clear_memory_region_dirty_bitmap_range(block, 0,
+                                block->used_length >> TARGET_PAGE_BITS);
+        }
+    }
+    ram_incremental_base = true;
+    file_set_incremental_base();
+}
+
+/*
+ * Stop the dirty log that was left running for x-mapped-ram-incremental.
+ * The next migration writes everything again.
+ */
+void ram_incremental_drop_base(void)
+{
+    if (!ram_incremental_base) {
+        return;
+    }
+    ram_incremental_base = false;
+    if (global_dirty_tracking & GLOBAL_DIRTY_MIGRATION) {
+        memory_global_dirty_log_stop(GLOBAL_DIRTY_MIGRATION);
     }
 }
 
@@ -2479,12 +2847,17 @@ static void ram_save_cleanup(void *opaque)
          * no writing race against the migration bitmap
          */
         if (global_dirty_tracking & GLOBAL_DIRTY_MIGRATION) {
-            /*
-             * do not stop dirty log without starting it, since
-             * memory_global_dirty_log_stop will assert that
-             * memory_global_dirty_log_start/stop used in pairs
-             */
-            memory_global_dirty_log_stop(GLOBAL_DIRTY_MIGRATION);
+            if (migrate_mapped_ram_incremental() &&
+                migrate_get_current()->state == MIGRATION_STATUS_COMPLETED) {
+                ram_incremental_keep_dirty_log();
+            } else {
+                /*
+                 * do not stop dirty log without starting it, since
+                 * memory_global_dirty_log_stop will assert that
+                 * memory_global_dirty_log_start/stop used in pairs
+                 */
+                memory_global_dirty_log_stop(GLOBAL_DIRTY_MIGRATION);
+            }
         }
     }
 
@@ -2821,8 +3194,25 @@ static bool ram_state_init(RAMState **rsp, Error **errp)
      * This must match with the initial values of dirty bitmap.
      */
     (*rsp)->migration_dirty_pages = (*rsp)->ram_bytes_total >> TARGET_PAGE_BITS;
+    if (migrate_mapped_ram_incremental() && ram_incremental_base &&
+        file_is_incremental_base()) {
+        /* Only what the dirty log reports will be sent */
+        (*rsp)->incremental = true;
+        (*rsp)->migration_dirty_pages = 0;
+    }
     ram_state_reset(*rsp);
 
+    /*
+     * With multifd, the user already told us how many CPUs migration
+     * may use; use the same number to merge the dirty bitmaps.
+     */
+    if (migrate_multifd() && migrate_multifd_channels() > 1) {
+        (*rsp)->sync_nr_threads = migrate_multifd_channels();
+        (*rsp)->sync_threads = thread_pool_new();
+        thread_pool_set_max_threads((*rsp)->sync_threads,
+                                    (*rsp)->sync_nr_threads - 1);
+    }
+
     return true;
 }
 
@@ -2856,14 +3246,26 @@ static void ram_list_init_bitmaps(void)
              * new migration after a failed migration, ram_list.
              * dirty_memory[DIRTY_MEMORY_MIGRATION] don't include the whole
              * guest memory.
+             * An incremental migration starts from an empty bitmap, and
+             * the first sync brings in what was dirtied since the last
+             * one completed.
              */
             block->bmap = bitmap_new(pages);
-            bitmap_set(block->bmap, 0, pages);
+            if (!ram_state->incremental) {
+                bitmap_set(block->bmap, 0, pages);
+            }
             if (migrate_mapped_ram()) {
                 block->file_bmap = bitmap_new(pages);
             }
             block->clear_bmap_shift = shift;
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
+            if (migrate_defer_hot_pages()) {
+                unsigned long chunks = DIV_ROUND_UP(pages,
+                                                    1UL << RAM_HOT_CHUNK_SHIFT);
+
+                block->hotness = g_new0(uint8_t, chunks);
+                block->hot_bmap = bitmap_new(chunks);
+            }
         }
     }
 }
@@ -2898,6 +3300,7 @@ static bool ram_init_bitmaps(RAMState *rs, Error **errp)
             migration_bitmap_sync_precopy(false);
         }
     }
+    ram_incremental_base = false;
 out_unlock:
     qemu_mutex_unlock_ramlist();
 
@@ -3033,6 +3436,28 @@ struct MappedRamHeader {
 } QEMU_PACKED;
 typedef struct MappedRamHeader MappedRamHeader;
 
+/*
+ * For an incremental migration, check that the file already has the
+ * same layout for @block at the same place, and start from the bitmap
+ * of pages present there.
+ */
+static bool mapped_ram_load_base(QEMUFile *file, RAMBlock *block,
+                                 const MappedRamHeader *header, off_t pos,
+                                 size_t bitmap_size)
+{
+    QIOChannel *ioc = qemu_file_get_ioc(file);
+    MappedRamHeader base;
+    ssize_t ret;
+
+    ret = qio_channel_pread(ioc, (char *)&base, sizeof(base), pos, NULL);
+    if (ret != sizeof(base) || memcmp(&base, header, sizeof(base))) {
+        return false;
+    }
+    ret = qio_channel_pread(ioc, (char *)block->file_bmap, bitmap_size,
+                            block->bitmap_offset, NULL);
+    return ret == bitmap_size;
+}
+
 static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
 {
     g_autofree MappedRamHeader *header = NULL;
@@ -3060,6 +3485,18 @@ static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
     header->bitmap_offset = cpu_to_be64(block->bitmap_offset);
     header->pages_offset = cpu_to_be64(block->pages_offset);
 
+    if (ram_state->incremental &&
+        !mapped_ram_load_base(file, block, header,
+                              block->bitmap_offset - header_size,
+                              bitmap_size)) {
+        /* Not written by the previous migration, send all of it */
+        trace_mapped_ram_incremental_fallback(block->idstr);
+        bitmap_zero(block->file_bmap, num_pages);
+        ram_state->migration_dirty_pages +=
+            num_pages - bitmap_count_one(block->bmap, num_pages);
+        bitmap_set(block->bmap, 0, num_pages);
+    }
+
     qemu_put_buffer(file, (uint8_t *) header, header_size);
 
     /* prepare offset for next ramblock */
@@ -3462,6 +3899,7 @@ static void ram_state_pending_exact(void *opaque, uint64_t *must_precopy,
 {
     RAMState **temp = opaque;
     RAMState *rs = *temp;
+    bool hot_pages_deferred = rs->hot_pages_deferred;
     uint64_t remaining_size;
 
     if (!migration_in_postcopy()) {
@@ -3474,6 +3912,16 @@ static void ram_state_pending_exact(void *opaque, uint64_t *must_precopy,
 
     remaining_size = rs->migration_dirty_pages * TARGET_PAGE_SIZE;
 
+    /*
+     * The last pass only found hot pages and yet too much is left to
+     * switch over: the hot set is what keeps the migration from
+     * converging, so stop holding it back.
+     */
+    if (hot_pages_deferred &&
+        remaining_size > migrate_get_current()->threshold_size) {
+        rs->hot_pages_off = true;
+    }
+
     if (migrate_postcopy_ram()) {
         /* We can do postcopy, and all the data is postcopiable */
         *can_postcopy += remaining_size;
@@ -4030,6 +4478,7 @@ static size_t ram_load_multifd_pages(void *host_addr, size_t size,
     data->opaque = host_addr;
     data->file_offset = offset;
     data->size = size;
+    data->zero = false;
 
     if (!multifd_recv()) {
         return 0;
@@ -4038,6 +4487,18 @@ static size_t ram_load_multifd_pages(void *host_addr, size_t size,
     return size;
 }
 
+static bool ram_load_multifd_zero(void *host_addr, size_t size)
+{
+    MultiFDRecvData *data = multifd_get_recv_data();
+
+    data->opaque = host_addr;
+    data->file_offset = 0;
+    data->size = size;
+    data->zero = true;
+
+    return multifd_recv();
+}
+
 /**
  * handle_zero_mapped_ram: Zero out a range of RAM pages if required during
  * mapped-ram load
@@ -4079,7 +4540,29 @@ static bool handle_zero_mapped_ram(RAMBlock *block, unsigned long from_bit_idx,
                    block->idstr);
         return false;
     }
-    ram_handle_zero(host, size);
+
+    if (!migrate_multifd()) {
+        ram_handle_zero(host, size);
+        return true;
+    }
+
+    /*
+     * ram_handle_zero() has to read the whole range to avoid dirtying
+     * pages that are already zero, spread it over the channels like
+     * the reads.
+     */
+    while (size) {
+        size_t len = MIN(size, MAPPED_RAM_LOAD_BUF_SIZE);
+
+        if (!ram_load_multifd_zero(host, len)) {
+            error_setg(errp, "(%s) failed to queue zeroing of page "
+                       RAM_ADDR_FMT, block->idstr, offset);
+            return false;
+        }
+        host = (uint8_t *)host + len;
+        offset += len;
+        size -= len;
+    }
 
     return true;
 }
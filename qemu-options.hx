@@ -231,6 +231,7 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
+    "                partial-flush=on|off (evict only the oldest TCG translations when full)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
@@ -267,6 +268,14 @@ SRST
         can be useful in some situations, such as when trying to analyse
         the logs produced by the ``-d`` option.
 
+    ``partial-flush=on|off``
+        When the TCG translation block cache is full, discard only the
+        translations in its least recently allocated region instead of
+        flushing the whole cache. This avoids re-translating all hot code
+        at once on long-running guests. It only takes effect with
+        multi-threaded TCG, where the cache is split into several
+        regions. The default is off.
+
     ``split-wx=on|off``
         Controls the use of split w^x mapping for the TCG code generation
         buffer. Some operating systems require this to be enabled, and in
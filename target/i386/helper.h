@@ -60,6 +60,8 @@ DEF_HELPER_FLAGS_2(raise_exception, TCG_CALL_NO_WG, noreturn, env, int)
 DEF_HELPER_FLAGS_1(icebp, TCG_CALL_NO_WG, noreturn, env)
 DEF_HELPER_3(boundw, void, env, tl, int)
 DEF_HELPER_3(boundl, void, env, tl, int)
+DEF_HELPER_FLAGS_4(rep_stos, TCG_CALL_NO_WG, tl, env, tl, tl, i32)
+DEF_HELPER_FLAGS_4(rep_movs, TCG_CALL_NO_WG, tl, env, tl, tl, i32)
 
 #ifndef CONFIG_USER_ONLY
 DEF_HELPER_1(rsm, void, env)
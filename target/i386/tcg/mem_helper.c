@@ -21,11 +21,153 @@
 #include "cpu.h"
 #include "exec/helper-proto.h"
 #include "accel/tcg/cpu-ldst.h"
+#include "accel/tcg/helper-retaddr.h"
+#include "accel/tcg/probe.h"
+#include "exec/target_page.h"
 #include "qemu/int128.h"
 #include "qemu/atomic128.h"
 #include "tcg/tcg.h"
 #include "helper-tcg.h"
 
+/*
+ * Bulk REP STOS and REP MOVS.  @desc holds the operand size in bits [1:0],
+ * the address size in bits [3:2] and the mmu index above.
+ *
+ * Perform as many iterations as fit within the current page of each
+ * operand directly on host memory, and return how many were done.
+ * Return 0 whenever the translator's one-iteration-at-a-time loop must
+ * be used instead: DF set, I/O, watchpoints, clean pages and the like,
+ * all of which tlb_vaddr_to_host() refuses to map.
+ */
+static target_ulong rep_count(CPUX86State *env, uint32_t desc)
+{
+    MemOp aflag = extract32(desc, 2, 2);
+
+    if (env->df != 1) {
+        return 0;
+    }
+    return aflag == MO_32 ? (uint32_t)env->regs[R_ECX] : env->regs[R_ECX];
+}
+
+static target_ulong rep_limit(CPUX86State *env, target_ulong addr,
+                              int reg, uint32_t desc)
+{
+    MemOp ot = extract32(desc, 0, 2);
+    MemOp aflag = extract32(desc, 2, 2);
+    uint64_t bytes = TARGET_PAGE_ALIGN(addr + 1) - addr;
+
+    /* Do not let a 32-bit index register wrap around. */
+    if (aflag == MO_32) {
+        bytes = MIN(bytes, (1ull << 32) - (uint32_t)env->regs[reg]);
+    }
+    return bytes >> ot;
+}
+
+/*
+ * Return the host address of @len bytes at @addr, which do not cross a
+ * page, or NULL if the one-iteration-at-a-time loop must be used.
+ */
+static void *rep_host(CPUX86State *env, target_ulong addr, target_ulong len,
+                      MMUAccessType access_type, int mmu_idx, uintptr_t ra)
+{
+#ifdef CONFIG_USER_ONLY
+    void *host;
+
+    /*
+     * tlb_vaddr_to_host() does not check the guest mapping here.  A fault
+     * partway through the copy would be delivered with ECX, ESI and EDI
+     * not yet updated for the elements already done, so leave unmapped
+     * pages to the slow loop, which raises the fault on the right element.
+     */
+    if (probe_access_flags(env, addr, len, access_type, mmu_idx,
+                           true, &host, ra)) {
+        return NULL;
+    }
+    return host;
+#else
+    return tlb_vaddr_to_host(env, addr, access_type, mmu_idx);
+#endif
+}
+
+target_ulong helper_rep_stos(CPUX86State *env, target_ulong dst,
+                             target_ulong val, uint32_t desc)
+{
+    MemOp ot = extract32(desc, 0, 2);
+    int mmu_idx = extract32(desc, 4, 8);
+    target_ulong i, n;
+    void *host;
+
+    n = MIN(rep_count(env, desc), rep_limit(env, dst, R_EDI, desc));
+    if (n == 0) {
+        return 0;
+    }
+    host = rep_host(env, dst, n << ot, MMU_DATA_STORE, mmu_idx, GETPC());
+    if (!host) {
+        return 0;
+    }
+
+    set_helper_retaddr(GETPC());
+    switch (ot) {
+    case MO_8:
+        memset(host, val, n);
+        break;
+    case MO_16:
+        for (i = 0; i < n; i++) {
+            stw_le_p(host + i * 2, val);
+        }
+        break;
+    case MO_32:
+        for (i = 0; i < n; i++) {
+            stl_le_p(host + i * 4, val);
+        }
+        break;
+    case MO_64:
+        for (i = 0; i < n; i++) {
+            stq_le_p(host + i * 8, val);
+        }
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    clear_helper_retaddr();
+    return n;
+}
+
+target_ulong helper_rep_movs(CPUX86State *env, target_ulong dst,
+                             target_ulong src, uint32_t desc)
+{
+    MemOp ot = extract32(desc, 0, 2);
+    int mmu_idx = extract32(desc, 4, 8);
+    target_ulong n, len;
+    void *hdst, *hsrc;
+
+    n = MIN(rep_count(env, desc), rep_limit(env, dst, R_EDI, desc));
+    n = MIN(n, rep_limit(env, src, R_ESI, desc));
+    if (n == 0) {
+        return 0;
+    }
+    len = n << ot;
+    hsrc = rep_host(env, src, len, MMU_DATA_LOAD, mmu_idx, GETPC());
+    hdst = rep_host(env, dst, len, MMU_DATA_STORE, mmu_idx, GETPC());
+    if (!hsrc || !hdst) {
+        return 0;
+    }
+
+    /*
+     * Copying forward one element at a time into an overlapping
+     * destination above the source replicates the leading elements,
+     * which memmove does not.
+     */
+    if (hdst > hsrc && hdst < hsrc + len) {
+        return 0;
+    }
+
+    set_helper_retaddr(GETPC());
+    memmove(hdst, hsrc, len);
+    clear_helper_retaddr();
+    return n;
+}
+
 void helper_boundw(CPUX86State *env, target_ulong a0, int v)
 {
     int low, high;
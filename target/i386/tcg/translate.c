@@ -1351,6 +1351,46 @@ static void gen_outs(DisasContext *s, MemOp ot, TCGv dshift)
 
 #define REP_MAX 65535
 
+/*
+ * When the bulk helper gives up, e.g. on an element that straddles a page,
+ * only run this many iterations one at a time before trying it again.
+ */
+#define REP_BULK_RETRY 15
+
+/*
+ * For REP MOVS and REP STOS, try to perform the iterations that fit in
+ * one page with a single helper call.  Return false if @fn has no bulk
+ * variant; otherwise store the number of iterations done in @n, which is
+ * zero if the caller must go through the one-at-a-time loop.
+ *
+ * The helpers access host memory directly, which plugins cannot see, so
+ * only use them if no plugin instruments this translation block.
+ */
+static bool gen_rep_bulk(DisasContext *s, MemOp ot, TCGv n,
+                         void (*fn)(DisasContext *s, MemOp ot, TCGv dshift))
+{
+    TCGv_i32 desc = tcg_constant_i32(ot | (s->aflag << 2) |
+                                     (s->mem_index << 4));
+
+    if (s->aflag == MO_16 || s->base.plugin_enabled) {
+        return false;
+    }
+    if (fn == gen_stos) {
+        gen_string_movl_A0_EDI(s);
+        gen_helper_rep_stos(n, tcg_env, s->A0, s->T0, desc);
+    } else if (fn == gen_movs) {
+        TCGv src = tcg_temp_new();
+
+        gen_string_movl_A0_ESI(s);
+        tcg_gen_mov_tl(src, s->A0);
+        gen_string_movl_A0_EDI(s);
+        gen_helper_rep_movs(n, tcg_env, s->A0, src, desc);
+    } else {
+        return false;
+    }
+    return true;
+}
+
 static void do_gen_rep(DisasContext *s, MemOp ot, TCGv dshift,
                        void (*fn)(DisasContext *s, MemOp ot, TCGv dshift),
                        bool is_repz_nz)
@@ -1358,8 +1398,10 @@ static void do_gen_rep(DisasContext *s, MemOp ot, TCGv dshift,
     TCGLabel *last = gen_new_label();
     TCGLabel *loop = gen_new_label();
     TCGLabel *done = gen_new_label();
+    TCGLabel *reenter = gen_new_label();
 
     target_ulong cx_mask = MAKE_64BIT_MASK(0, 8 << s->aflag);
+    target_ulong rep_max = REP_MAX;
     TCGv cx_next = tcg_temp_new();
 
     /*
@@ -1395,6 +1437,29 @@ static void do_gen_rep(DisasContext *s, MemOp ot, TCGv dshift,
     /* Any iteration at all?  */
     tcg_gen_brcondi_tl(TCG_COND_TSTEQ, cpu_regs[R_ECX], cx_mask, done);
 
+    /*
+     * Do a page worth of iterations at once if possible, then go back to
+     * the main loop so that interrupts are still checked between pages.
+     */
+    if (can_loop) {
+        TCGLabel *slow = gen_new_label();
+        TCGv n = tcg_temp_new();
+
+        if (gen_rep_bulk(s, ot, n, fn)) {
+            tcg_gen_brcondi_tl(TCG_COND_EQ, n, 0, slow);
+            tcg_gen_shli_tl(s->T1, n, ot);
+            if (fn == gen_movs) {
+                gen_op_add_reg(s, s->aflag, R_ESI, s->T1);
+            }
+            gen_op_add_reg(s, s->aflag, R_EDI, s->T1);
+            tcg_gen_neg_tl(n, n);
+            gen_op_add_reg(s, s->aflag, R_ECX, n);
+            tcg_gen_br(reenter);
+            gen_set_label(slow);
+            rep_max = REP_BULK_RETRY;
+        }
+    }
+
     /*
      * From now on we operate on the value of CX/ECX/RCX that will be written
      * back, which is stored in cx_next.  There can be no carry, so we can zero
@@ -1431,7 +1496,7 @@ static void do_gen_rep(DisasContext *s, MemOp ot, TCGv dshift,
 
     if (can_loop) {
         tcg_gen_subi_tl(cx_next, cx_next, 1);
-        tcg_gen_brcondi_tl(TCG_COND_TSTNE, cx_next, REP_MAX, loop);
+        tcg_gen_brcondi_tl(TCG_COND_TSTNE, cx_next, rep_max, loop);
         tcg_gen_brcondi_tl(TCG_COND_TSTEQ, cx_next, cx_mask, last);
     }
 
@@ -1440,6 +1505,7 @@ static void do_gen_rep(DisasContext *s, MemOp ot, TCGv dshift,
      * but the last.  Set it here before giving the main loop a chance to
      * execute.  (For faults, seg_helper.c sets the flag as usual).
      */
+    gen_set_label(reenter);
     if (!had_rf) {
         gen_set_eflags(s, RF_MASK);
     }
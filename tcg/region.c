@@ -72,6 +72,8 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    uint64_t *alloc_seq; /* per region: allocation order, 0 if unallocated */
+    uint64_t next_seq;
 };
 
 static struct tcg_region_state region;
@@ -191,10 +193,23 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Return the index of the region containing @p, in the rw buffer. */
+static size_t tcg_region_index(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
 
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -206,18 +221,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
         }
     }
 
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -359,11 +363,23 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
-        return true;
+    size_t i = region.current;
+
+    if (i == region.n) {
+        /* Reuse a region released by tcg_region_evict_oldest, if any. */
+        for (i = 0; i < region.n; i++) {
+            if (region.alloc_seq[i] == 0) {
+                break;
+            }
+        }
+        if (i == region.n) {
+            return true;
+        }
+    } else {
+        region.current++;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, i);
+    region.alloc_seq[i] = ++region.next_seq;
     return false;
 }
 
@@ -412,6 +428,7 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    memset(region.alloc_seq, 0, region.n * sizeof(*region.alloc_seq));
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -422,6 +439,70 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/*
+ * Call from a safe-work context.
+ *
+ * Release the least recently allocated region that no context is using.
+ * Each TB in it is passed to @func, which must make the TB unreachable,
+ * before the region is returned to the pool.  Nothing is released if
+ * a region is already free, e.g. because another vCPU thread asked for
+ * space at the same time.  Returns 1 if a region was released, 0 if one
+ * was already free, and -1 if no region can be released.
+ */
+int tcg_region_evict_oldest(GTraverseFunc func, gpointer user_data)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    g_autofree bool *in_use = NULL;
+    struct tcg_region_tree *rt;
+    size_t i, victim = region.n;
+    void *start, *end;
+    int ret = 0;
+
+    qemu_mutex_lock(&region.lock);
+    if (region.current < region.n) {
+        goto out;
+    }
+    for (i = 0; i < region.n; i++) {
+        if (region.alloc_seq[i] == 0) {
+            goto out;
+        }
+    }
+
+    in_use = g_new0(bool, region.n);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+        in_use[tcg_region_index(s->code_gen_buffer)] = true;
+    }
+    for (i = 0; i < region.n; i++) {
+        if (!in_use[i] && (victim == region.n ||
+                           region.alloc_seq[i] < region.alloc_seq[victim])) {
+            victim = i;
+        }
+    }
+    if (victim == region.n) {
+        ret = -1;
+        goto out;
+    }
+
+    rt = region_trees + victim * tree_size;
+    qemu_mutex_lock(&rt->lock);
+    q_tree_foreach(rt->tree, func, user_data);
+    /* Increment the refcount first so that destroy acts as a reset */
+    q_tree_ref(rt->tree);
+    q_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    /* The region was accounted as full when its last context left it. */
+    tcg_region_bounds(victim, &start, &end);
+    region.agg_size_full -= end - start - TCG_HIGHWATER;
+    region.alloc_seq[victim] = 0;
+    ret = 1;
+
+ out:
+    qemu_mutex_unlock(&region.lock);
+    return ret;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_threads)
 {
 #ifdef CONFIG_USER_ONLY
@@ -555,16 +636,31 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
 static int alloc_code_gen_buffer_anon(size_t size, int prot,
                                       int flags, Error **errp)
 {
-    void *buf;
+    /*
+     * Align the start of the buffer so that transparent huge pages can
+     * back it from the first byte; translated code is hot in the iTLB.
+     * Over-allocate by the alignment and trim the excess at either end.
+     */
+    const size_t align = QEMU_VMALLOC_ALIGN;
+    const size_t total = size + align - qemu_real_host_page_size();
+    void *buf, *aligned;
 
-    buf = mmap(NULL, size, prot, flags, -1, 0);
+    buf = mmap(NULL, total, prot, flags, -1, 0);
     if (buf == MAP_FAILED) {
         error_setg_errno(errp, errno,
                          "allocate %zu bytes for jit buffer", size);
         return -1;
     }
 
-    region.start_aligned = buf;
+    aligned = QEMU_ALIGN_PTR_UP(buf, align);
+    if (aligned != buf) {
+        munmap(buf, aligned - buf);
+    }
+    if (buf + total != aligned + size) {
+        munmap(aligned + size, (buf + total) - (aligned + size));
+    }
+
+    region.start_aligned = aligned;
     region.total_size = size;
     return prot;
 }
@@ -805,6 +901,7 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.alloc_seq = g_new0(uint64_t, region.n);
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
@@ -0,0 +1,132 @@
+/*
+ * QEMU qcow2 metadata cache speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/main-loop.h"
+#include "qapi/error.h"
+#include "qobject/qdict.h"
+#include "block/block-global-state.h"
+#include "system/block-backend.h"
+
+/*
+ * With 4k clusters, each L2 table maps 2M of guest data.  The image has
+ * one allocated cluster at the start of each of these 2M areas, so that
+ * all of its L2 tables exist.  Reads go to the unallocated clusters
+ * next to it: they need the L2 table but no data from the file, which
+ * keeps the cost of the cache lookup visible.
+ */
+#define CLUSTER_SIZE    (4 * KiB)
+#define L2_COVERAGE     (2 * MiB)
+#define NR_TABLES       8192
+
+static char *image;
+
+typedef struct QCow2CacheBenchOpts {
+    const char *name;
+    /* Number of L2 tables that fit in the cache */
+    int cached_tables;
+} QCow2CacheBenchOpts;
+
+static BlockBackend *open_image(int cached_tables)
+{
+    QDict *opts = qdict_new();
+
+    qdict_put_str(opts, "driver", "qcow2");
+    qdict_put_int(opts, "l2-cache-size",
+                  (int64_t)cached_tables * CLUSTER_SIZE);
+    qdict_put_str(opts, "file.locking", "off");
+
+    return blk_new_open(image, NULL, opts, BDRV_O_RDWR, &error_abort);
+}
+
+static void prepare_image(void)
+{
+    g_autofree void *buf = g_malloc0(CLUSTER_SIZE);
+    g_autofree char *create_opts =
+        g_strdup_printf("cluster_size=%d", (int)CLUSTER_SIZE);
+    BlockBackend *blk;
+    int fd, i;
+
+    image = g_strdup_printf("%s/qcow2-cache-bench.XXXXXX", g_get_tmp_dir());
+    fd = g_mkstemp(image);
+    g_assert(fd >= 0);
+    close(fd);
+
+    bdrv_img_create(image, "qcow2", NULL, NULL, create_opts,
+                    (uint64_t)NR_TABLES * L2_COVERAGE, 0, true,
+                    &error_abort);
+
+    blk = open_image(16);
+    memset(buf, 0xa5, CLUSTER_SIZE);
+    for (i = 0; i < NR_TABLES; i++) {
+        g_assert(blk_pwrite(blk, (int64_t)i * L2_COVERAGE, CLUSTER_SIZE,
+                            buf, 0) == 0);
+    }
+    blk_unref(blk);
+}
+
+static void test_cache_speed(const void *opaque)
+{
+    const QCow2CacheBenchOpts *opts = opaque;
+    g_autofree void *buf = g_malloc(512);
+    BlockBackend *blk = open_image(opts->cached_tables);
+    uint64_t lookups = 0;
+    int i;
+
+    /* Warm up the cache */
+    for (i = 0; i < MIN(opts->cached_tables, NR_TABLES); i++) {
+        g_assert(blk_pread(blk, (int64_t)i * L2_COVERAGE + CLUSTER_SIZE,
+                           512, buf, 0) == 0);
+    }
+
+    g_test_timer_start();
+    do {
+        int64_t table = g_test_rand_int_range(0, NR_TABLES);
+        int64_t cluster = g_test_rand_int_range(1, L2_COVERAGE / CLUSTER_SIZE);
+
+        g_assert(blk_pread(blk, table * L2_COVERAGE + cluster * CLUSTER_SIZE,
+                           512, buf, 0) == 0);
+        lookups++;
+    } while (g_test_timer_elapsed() < 1.0);
+
+    g_test_message("qcow2 cache %s: %d/%d tables cached, %.0f ns/read",
+                   opts->name, MIN(opts->cached_tables, NR_TABLES), NR_TABLES,
+                   g_test_timer_last() * 1e9 / lookups);
+
+    blk_unref(blk);
+}
+
+static const QCow2CacheBenchOpts bench_opts[] = {
+    { .name = "hit", .cached_tables = NR_TABLES },
+    { .name = "miss-50%", .cached_tables = NR_TABLES / 2 },
+    { .name = "miss-90%", .cached_tables = NR_TABLES / 10 },
+};
+
+int main(int argc, char **argv)
+{
+    int i, ret;
+
+    qemu_init_main_loop(&error_fatal);
+    bdrv_init();
+
+    g_test_init(&argc, &argv, NULL);
+    prepare_image();
+
+    for (i = 0; i < ARRAY_SIZE(bench_opts); i++) {
+        g_autofree char *path =
+            g_strdup_printf("/qcow2/cache/speed/%s", bench_opts[i].name);
+
+        g_test_add_data_func(path, &bench_opts[i], test_cache_speed);
+    }
+
+    ret = g_test_run();
+
+    unlink(image);
+    g_free(image);
+    return ret;
+}
@@ -58,6 +58,27 @@ static void test_multifd_postcopy_tcp_zstd(void)
 }
 #endif /* CONFIG_ZSTD */
 
+#ifdef CONFIG_LZ4
+static void *
+migrate_hook_start_precopy_tcp_multifd_lz4(QTestState *from,
+                                           QTestState *to)
+{
+    return migrate_hook_start_precopy_tcp_multifd_common(from, to, "lz4");
+}
+
+static void test_multifd_tcp_lz4(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start = {
+            .caps[MIGRATION_CAPABILITY_MULTIFD] = true,
+        },
+        .start_hook = migrate_hook_start_precopy_tcp_multifd_lz4,
+    };
+    test_precopy_common(&args);
+}
+#endif /* CONFIG_LZ4 */
+
 #ifdef CONFIG_QATZIP
 static void *
 migrate_hook_start_precopy_tcp_multifd_qatzip(QTestState *from,
@@ -179,6 +200,30 @@ static void test_multifd_tcp_zlib(void)
     test_precopy_common(&args);
 }
 
+static void *
+migrate_hook_start_precopy_tcp_multifd_xbzrle(QTestState *from,
+                                              QTestState *to)
+{
+    migrate_set_parameter_int(from, "xbzrle-cache-size", 33554432);
+
+    return migrate_hook_start_precopy_tcp_multifd_common(from, to, "xbzrle");
+}
+
+static void test_multifd_tcp_xbzrle(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start = {
+            .caps[MIGRATION_CAPABILITY_MULTIFD] = true,
+        },
+        .start_hook = migrate_hook_start_precopy_tcp_multifd_xbzrle,
+        .iterations = 2,
+        /* Pages must be re-dirtied for deltas to be sent */
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+
 static void migration_test_add_compression_smoke(MigrationTestEnv *env)
 {
     migration_test_add("/migration/multifd/tcp/plain/zlib",
@@ -195,6 +240,9 @@ void migration_test_add_compression(MigrationTestEnv *env)
         return;
     }
 
+    migration_test_add("/migration/multifd/tcp/plain/xbzrle",
+                       test_multifd_tcp_xbzrle);
+
 #ifdef CONFIG_ZSTD
     migration_test_add("/migration/multifd/tcp/plain/zstd",
                        test_multifd_tcp_zstd);
@@ -204,6 +252,11 @@ void migration_test_add_compression(MigrationTestEnv *env)
     }
 #endif
 
+#ifdef CONFIG_LZ4
+    migration_test_add("/migration/multifd/tcp/plain/lz4",
+                       test_multifd_tcp_lz4);
+#endif
+
 #ifdef CONFIG_QATZIP
     migration_test_add("/migration/multifd/tcp/plain/qatzip",
                        test_multifd_tcp_qatzip);
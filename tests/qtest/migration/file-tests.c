@@ -137,6 +137,45 @@ static void test_precopy_file_mapped_ram(void)
     test_file_common(&args, true);
 }
 
+static void *migrate_hook_start_mapped_ram_incremental(QTestState *from,
+                                                       QTestState *to)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+
+    /*
+     * Write the whole of RAM once, then let the guest dirty it again so
+     * that the migration done by test_file_common() has something to
+     * add on top.
+     */
+    migrate_ensure_converge(from);
+    wait_for_serial("src_serial");
+    migrate_qmp(from, to, uri, NULL, "{}");
+    wait_for_migration_complete(from);
+
+    qtest_qmp_assert_success(from, "{ 'execute' : 'cont'}");
+    usleep(1000 * 200);
+
+    return NULL;
+}
+
+static void test_precopy_file_mapped_ram_incremental(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_hook_start_mapped_ram_incremental,
+        .start = {
+            .caps[MIGRATION_CAPABILITY_MAPPED_RAM] = true,
+            .caps[MIGRATION_CAPABILITY_X_MAPPED_RAM_INCREMENTAL] = true,
+        },
+    };
+
+    test_file_common(&args, false);
+}
+
 static void test_multifd_file_mapped_ram_live(void)
 {
     g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
@@ -326,6 +365,8 @@ void migration_test_add_file(MigrationTestEnv *env)
                        test_precopy_file_mapped_ram);
     migration_test_add("/migration/precopy/file/mapped-ram/live",
                        test_precopy_file_mapped_ram_live);
+    migration_test_add("/migration/precopy/file/mapped-ram/incremental",
+                       test_precopy_file_mapped_ram_incremental);
 
     migration_test_add("/migration/multifd/file/mapped-ram",
                        test_multifd_file_mapped_ram);
@@ -461,6 +461,65 @@ static void test_auto_converge(void)
     migrate_end(from, to, true);
 }
 
+/*
+ * The guest dirties all of its memory all the time, so with
+ * x-defer-hot-pages every page soon counts as hot, and there is far
+ * more of it than fits in the downtime limit.  Check that the hot pages
+ * keep being sent and that the migration still converges, with the
+ * help of auto-converge as it would without deferral.
+ */
+static void test_precopy_defer_hot_pages(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateStart args = {};
+    QTestState *from, *to;
+    int64_t transferred;
+    uint64_t pass;
+
+    if (migrate_start(&from, &to, uri, &args)) {
+        return;
+    }
+
+    migrate_set_capability(from, "x-defer-hot-pages", true);
+    migrate_set_capability(from, "auto-converge", true);
+    migrate_set_parameter_int(from, "max-cpu-throttle", 99);
+
+    /* Send RAM quickly, but leave almost no room for deferred pages */
+    migrate_set_parameter_int(from, "max-bandwidth", 100 * 1000 * 1000);
+    migrate_set_parameter_int(from, "downtime-limit", 1);
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    migrate_qmp(from, to, uri, NULL, "{}");
+
+    /* Let the hot set build up over several dirty bitmap syncs */
+    while ((pass = get_migration_pass(from)) < 6) {
+        usleep(100 * 1000);
+        g_assert_false(get_src()->stop_seen);
+    }
+
+    /* The hot pages must not be held back forever */
+    transferred = read_ram_property_int(from, "transferred");
+    while (get_migration_pass(from) < pass + 2) {
+        usleep(100 * 1000);
+        g_assert_false(get_src()->stop_seen);
+    }
+    g_assert_cmpint(read_ram_property_int(from, "transferred"), >,
+                    transferred + 64 * 1024);
+
+    /* 50MB fit in the downtime limit, less than the guest keeps dirty */
+    migrate_set_parameter_int(from, "max-bandwidth", 1000 * 1000 * 1000);
+    migrate_set_parameter_int(from, "downtime-limit", 50);
+
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+    wait_for_migration_complete(from);
+
+    migrate_end(from, to, true);
+}
+
 static void *
 migrate_hook_start_precopy_tcp_multifd(QTestState *from,
                                        QTestState *to)
@@ -1292,6 +1351,8 @@ void migration_test_add_precopy(MigrationTestEnv *env)
     if (g_test_slow()) {
         migration_test_add("/migration/auto_converge",
                            test_auto_converge);
+        migration_test_add("/migration/precopy/unix/defer-hot-pages",
+                           test_precopy_defer_hot_pages);
         if (g_str_equal(env->arch, "x86_64") &&
             env->has_kvm && env->has_dirty_ring) {
             migration_test_add("/dirty_limit",
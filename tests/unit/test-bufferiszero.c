@@ -58,13 +58,45 @@ static void test_1(void)
     }
 }
 
+static void test_batch(void)
+{
+    const void *bufs[64];
+    bool zero[64];
+    size_t s, i;
+
+    for (s = 1; s <= 4096; s *= 2) {
+        for (i = 0; i < ARRAY_SIZE(bufs); i++) {
+            bufs[i] = buffer + i * s;
+        }
+        g_assert_cmpuint(buffer_is_zero_batch(bufs, ARRAY_SIZE(bufs), s,
+                                              zero), ==, ARRAY_SIZE(bufs));
+
+        /* Mark every third buffer, at a different offset each time.  */
+        for (i = 0; i < ARRAY_SIZE(bufs); i += 3) {
+            buffer[i * s + i % s] = 1;
+        }
+        g_assert_cmpuint(buffer_is_zero_batch(bufs, ARRAY_SIZE(bufs), s,
+                                              zero), ==,
+                         ARRAY_SIZE(bufs) - DIV_ROUND_UP(ARRAY_SIZE(bufs), 3));
+        for (i = 0; i < ARRAY_SIZE(bufs); i++) {
+            g_assert(zero[i] == (i % 3 != 0));
+            g_assert(zero[i] == buffer_is_zero(bufs[i], s));
+        }
+        for (i = 0; i < ARRAY_SIZE(bufs); i += 3) {
+            buffer[i * s + i % s] = 0;
+        }
+    }
+}
+
 static void test_2(void)
 {
     if (g_test_perf()) {
         test_1();
+        test_batch();
     } else {
         do {
             test_1();
+            test_batch();
         } while (test_buffer_is_zero_next_accel());
     }
 }
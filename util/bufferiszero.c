@@ -110,6 +110,34 @@ bool buffer_is_zero_ge256(const void *buf, size_t len)
     return buffer_is_zero_accel(buf, len);
 }
 
+/*
+ * Check @n buffers of @len bytes each, setting @zero[i] to whether
+ * @bufs[i] is all zeroes.  Returns the number of zero buffers.
+ *
+ * The three byte samples of every buffer are tested before any buffer
+ * is scanned in full, so that the cache misses of the cheap rejections
+ * overlap instead of being taken one buffer at a time.
+ */
+size_t buffer_is_zero_batch(const void *const *bufs, size_t n, size_t len,
+                            bool *zero)
+{
+    biz_accel_fn fn = len >= 256 ? buffer_is_zero_accel
+                                 : buffer_is_zero_int_lt256;
+    size_t i, count = 0;
+
+    for (i = 0; i < n; i++) {
+        zero[i] = len == 0 || buffer_is_zero_sample3(bufs[i], len);
+    }
+    for (i = 0; i < n; i++) {
+        /* All bytes are covered by the samples for any len <= 3.  */
+        if (zero[i] && len > 3) {
+            zero[i] = fn(bufs[i], len);
+        }
+        count += zero[i];
+    }
+    return count;
+}
+
 bool test_buffer_is_zero_next_accel(void)
 {
     if (accel_index != 0) {
@@ -46,8 +46,12 @@
 #include "qemu/osdep.h"
 #include <poll.h>
 #include "qapi/error.h"
+#include "block/aio-wait.h"
+#include "qemu/bitmap.h"
 #include "qemu/defer-call.h"
+#include "qemu/lockable.h"
 #include "qemu/rcu_queue.h"
+#include "qemu/units.h"
 #include "aio-posix.h"
 #include "trace.h"
 
@@ -441,6 +445,308 @@ static bool fdmon_io_uring_need_wait(AioContext *ctx)
     return false;
 }
 
+/*
+ * Fixed buffers
+ *
+ * Memory registered with aio_register_fixed_buf() is given the same buffer
+ * indices in the io_urings of all AioContexts, so that the index can be
+ * looked up before it is known which thread submits the request.  The kernel
+ * limits each fixed buffer to 1 GiB, larger regions take several consecutive
+ * indices.
+ *
+ * Lookups are done for every request and use RCU.  Changes are serialized
+ * by fixed_bufs.lock and replace the whole table.  Each index also counts
+ * the requests using it, so that it is only cleared and reused once they
+ * completed.
+ */
+enum {
+    FIXED_BUFS_MAX = 1024, /* number of fixed buffer indices in each ring */
+};
+
+#define FIXED_BUF_MAX_SIZE (1 * GiB)
+
+typedef struct {
+    void *host;
+    size_t size;
+    unsigned index; /* of the first fixed buffer */
+    unsigned refcnt;
+} FixedBufRegion;
+
+typedef struct {
+    struct rcu_head rcu;
+    unsigned nr;
+    FixedBufRegion regions[];
+} FixedBufTable;
+
+static struct {
+    QemuMutex lock;
+    FixedBufTable *table; /* RCU */
+    DECLARE_BITMAP(used, FIXED_BUFS_MAX);
+    unsigned inflight[FIXED_BUFS_MAX]; /* atomic, see aio_fixed_buf_get() */
+    GPtrArray *contexts; /* AioContexts with io_uring_fixed_bufs */
+} fixed_bufs;
+
+static void __attribute__((__constructor__)) fixed_bufs_init(void)
+{
+    qemu_mutex_init(&fixed_bufs.lock);
+    fixed_bufs.contexts = g_ptr_array_new();
+}
+
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+static unsigned fixed_buf_count(size_t size)
+{
+    return DIV_ROUND_UP(size, FIXED_BUF_MAX_SIZE);
+}
+
+/*
+ * Point the fixed buffers of a region at its memory in the ring of @ctx, or
+ * clear them if @host is NULL.  io_uring_register(2) may be called from any
+ * thread.
+ */
+static int fixed_buf_update(AioContext *ctx, unsigned index, void *host,
+                            size_t size)
+{
+    unsigned count = fixed_buf_count(size);
+    g_autofree struct iovec *iov = g_new0(struct iovec, count);
+    unsigned i;
+    int ret;
+
+    for (i = 0; host && i < count; i++) {
+        size_t offset = (size_t)i * FIXED_BUF_MAX_SIZE;
+
+        iov[i].iov_base = host + offset;
+        iov[i].iov_len = MIN(size - offset, FIXED_BUF_MAX_SIZE);
+    }
+
+    ret = io_uring_register_buffers_update_tag(&ctx->fdmon_io_uring, index,
+                                               iov, NULL, count);
+    return ret < 0 ? ret : 0;
+}
+
+/* Called with fixed_bufs.lock held */
+static void fixed_bufs_publish(FixedBufTable *table)
+{
+    FixedBufTable *old = fixed_bufs.table;
+
+    qatomic_rcu_set(&fixed_bufs.table, table);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+}
+
+static bool fixed_bufs_inflight(unsigned index, unsigned count)
+{
+    unsigned i;
+
+    for (i = 0; i < count; i++) {
+        if (qatomic_read(&fixed_bufs.inflight[index + i])) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif /* HAVE_IO_URING_REGISTER_BUFFERS_SPARSE */
+
+static void fixed_bufs_add_context(AioContext *ctx)
+{
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+    FixedBufTable *table;
+    unsigned i;
+
+    QEMU_LOCK_GUARD(&fixed_bufs.lock);
+
+    /* Fixed buffers are optional, requests can always do without them */
+    if (io_uring_register_buffers_sparse(&ctx->fdmon_io_uring,
+                                         FIXED_BUFS_MAX) < 0) {
+        return;
+    }
+
+    table = fixed_bufs.table;
+    for (i = 0; table && i < table->nr; i++) {
+        FixedBufRegion *r = &table->regions[i];
+
+        if (fixed_buf_update(ctx, r->index, r->host, r->size) < 0) {
+            io_uring_unregister_buffers(&ctx->fdmon_io_uring);
+            return;
+        }
+    }
+
+    g_ptr_array_add(fixed_bufs.contexts, ctx);
+    ctx->io_uring_fixed_bufs = true;
+#endif
+}
+
+static void fixed_bufs_remove_context(AioContext *ctx)
+{
+    QEMU_LOCK_GUARD(&fixed_bufs.lock);
+
+    if (ctx->io_uring_fixed_bufs) {
+        g_ptr_array_remove_fast(fixed_bufs.contexts, ctx);
+        ctx->io_uring_fixed_bufs = false;
+    }
+}
+
+bool aio_register_fixed_buf(void *host, size_t size, Error **errp)
+{
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+    FixedBufTable *old, *table;
+    unsigned count = fixed_buf_count(size);
+    unsigned nr, i;
+    unsigned long index;
+    int ret;
+
+    QEMU_LOCK_GUARD(&fixed_bufs.lock);
+
+    old = fixed_bufs.table;
+    nr = old ? old->nr : 0;
+    for (i = 0; i < nr; i++) {
+        if (old->regions[i].host == host && old->regions[i].size == size) {
+            old->regions[i].refcnt++;
+            return true;
+        }
+    }
+
+    if (!fixed_bufs.contexts->len) {
+        error_setg(errp, "io_uring fixed buffers are not supported by the "
+                   "host kernel");
+        return false;
+    }
+
+    index = bitmap_find_next_zero_area(fixed_bufs.used, FIXED_BUFS_MAX, 0,
+                                       count, 0);
+    if (index >= FIXED_BUFS_MAX) {
+        error_setg(errp, "Too many io_uring fixed buffers");
+        return false;
+    }
+
+    for (i = 0; i < fixed_bufs.contexts->len; i++) {
+        ret = fixed_buf_update(g_ptr_array_index(fixed_bufs.contexts, i),
+                               index, host, size);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Failed to register %p with size "
+                             "%zu as io_uring fixed buffers", host, size);
+            while (i-- > 0) {
+                fixed_buf_update(g_ptr_array_index(fixed_bufs.contexts, i),
+                                 index, NULL, size);
+            }
+            return false;
+        }
+    }
+    bitmap_set(fixed_bufs.used, index, count);
+
+    table = g_malloc(sizeof(*table) + (nr + 1) * sizeof(FixedBufRegion));
+    table->nr = nr + 1;
+    if (nr) {
+        memcpy(table->regions, old->regions, nr * sizeof(FixedBufRegion));
+    }
+    table->regions[nr] = (FixedBufRegion) {
+        .host = host,
+        .size = size,
+        .index = index,
+        .refcnt = 1,
+    };
+    fixed_bufs_publish(table);
+    return true;
+#else
+    error_setg(errp, "io_uring fixed buffers are not supported in this build");
+    return false;
+#endif
+}
+
+void aio_unregister_fixed_buf(void *host, size_t size)
+{
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+    FixedBufTable *old, *table;
+    FixedBufRegion r;
+    unsigned i;
+
+    qemu_mutex_lock(&fixed_bufs.lock);
+
+    old = fixed_bufs.table;
+    for (i = 0; old && i < old->nr; i++) {
+        if (old->regions[i].host == host && old->regions[i].size == size) {
+            break;
+        }
+    }
+    if (!old || i == old->nr || --old->regions[i].refcnt) {
+        qemu_mutex_unlock(&fixed_bufs.lock);
+        return;
+    }
+
+    /* Stop new lookups first */
+    r = old->regions[i];
+    table = g_malloc(sizeof(*table) + (old->nr - 1) * sizeof(FixedBufRegion));
+    table->nr = old->nr - 1;
+    memcpy(table->regions, old->regions, i * sizeof(FixedBufRegion));
+    memcpy(table->regions + i, old->regions + i + 1,
+           (old->nr - i - 1) * sizeof(FixedBufRegion));
+    fixed_bufs_publish(table);
+
+    qemu_mutex_unlock(&fixed_bufs.lock);
+
+    /*
+     * Then wait for the requests that already got the indices, including
+     * those not submitted yet and those that are resubmitted after a short
+     * read, before the memory is dropped from the rings.  The indices stay
+     * allocated until then, so they cannot be reused in the meantime.
+     */
+    synchronize_rcu();
+    AIO_WAIT_WHILE(NULL, fixed_bufs_inflight(r.index,
+                                             fixed_buf_count(r.size)));
+
+    QEMU_LOCK_GUARD(&fixed_bufs.lock);
+
+    for (i = 0; i < fixed_bufs.contexts->len; i++) {
+        fixed_buf_update(g_ptr_array_index(fixed_bufs.contexts, i),
+                         r.index, NULL, r.size);
+    }
+    bitmap_clear(fixed_bufs.used, r.index, fixed_buf_count(r.size));
+#endif
+}
+
+int aio_fixed_buf_get(const void *buf, size_t len)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    FixedBufTable *table;
+    unsigned i;
+    int index;
+
+    if (!ctx->io_uring_fixed_bufs || !len) {
+        return -1;
+    }
+
+    RCU_READ_LOCK_GUARD();
+
+    table = qatomic_rcu_read(&fixed_bufs.table);
+    for (i = 0; table && i < table->nr; i++) {
+        FixedBufRegion *r = &table->regions[i];
+        uintptr_t offset = (uintptr_t)buf - (uintptr_t)r->host;
+
+        if ((uintptr_t)buf < (uintptr_t)r->host || offset >= r->size ||
+            len > r->size - offset) {
+            continue;
+        }
+
+        /* The buffer must not cross into the next fixed buffer */
+        if (offset / FIXED_BUF_MAX_SIZE !=
+            (offset + len - 1) / FIXED_BUF_MAX_SIZE) {
+            return -1;
+        }
+
+        /* Count it before leaving RCU, see aio_unregister_fixed_buf() */
+        index = r->index + offset / FIXED_BUF_MAX_SIZE;
+        qatomic_inc(&fixed_bufs.inflight[index]);
+        return index;
+    }
+    return -1;
+}
+
+void aio_fixed_buf_put(int index)
+{
+    qatomic_dec(&fixed_bufs.inflight[index]);
+    aio_wait_kick();
+}
+
 static const FDMonOps fdmon_io_uring_ops = {
     .update = fdmon_io_uring_update,
     .wait = fdmon_io_uring_wait,
@@ -469,6 +775,7 @@ bool fdmon_io_uring_setup(AioContext *ctx, Error **errp)
     ctx->fdmon_ops = &fdmon_io_uring_ops;
     ctx->io_uring_fd_tag = g_source_add_unix_fd(&ctx->source,
             ctx->fdmon_io_uring.ring_fd, G_IO_IN);
+    fixed_bufs_add_context(ctx);
     return true;
 }
 
@@ -480,6 +787,7 @@ void fdmon_io_uring_destroy(AioContext *ctx)
         return;
     }
 
+    fixed_bufs_remove_context(ctx);
     io_uring_queue_exit(&ctx->fdmon_io_uring);
 
     /* Move handlers due to be removed onto the deleted list */